@@ -3,27 +3,39 @@
 
 #include <cstdio>
 #include <cstdint>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
 #include <fftw3.h>
 #include <SFML/Graphics.hpp>
 
 #include "CircularBuffer.hpp"
+#include "ConstantQ.hpp"
 #include "Spectrogram.hpp"
 #include "Recorder.hpp"
+#include "STFT.hpp"
+#include "PlanRegistry.hpp"
+#include "SampleFile.hpp"
+#include "FrameArena.hpp"
+#include "Pipeline.hpp"
+#include "Waterfall.hpp"
+#include "DBKernel.hpp"
+#include "StatsOverlay.hpp"
+#include "Resampler.hpp"
+#include "Config.hpp"
+#include "CaptureWriter.hpp"
 
-#define FFT_SIZE    1024
+#define PREWARM_FFT_SIZES   {256, 512, 2048, 4096, 8192}
+#define RENDER_WAIT_US      10000   // longest the UI sleeps before polling events
+#define STATS_REFRESH_MS    500     // overlay text rebuild interval
+#define STATS_LOG_SECONDS   10      // interval between appends to STATS_LOG_FILE
+#define STATS_LOG_FILE      "iir-test.stats"
+#define TRACK_OVERLAY_WIDTH 200     // tracked tone levels sit this far in from the right edge
 
-#define NUM_SECONDS         5
-#define NUM_CHANNELS        1
-#define TOTAL_FRAMES        NUM_SECONDS*SAMPLE_RATE
-#define NUM_SAMPLES         TOTAL_FRAMES*NUM_CHANNELS
-
-#define FUND_FREQ           ((float) ((float) SAMPLE_RATE/FFT_SIZE))
-
-#define WIN_WIDTH   1280
-#define WIN_HEIGHT  800
 class App {
     public:
-        App();
+        App(const Config &_config);
         App(const App&) = delete;
         App& operator=(const App&) = delete;
         ~App();
@@ -31,96 +43,232 @@ class App {
         void run();
         void handleEvents();
     private:
+        void drawFrame(const float *samples);
+        uint32_t analysisSize() const;
+        void drawSpectrum(const float *dB);
+        void updateStats();
+
+        Config config;
         sf::RenderWindow window;
-        fftwf_complex *out;
+        PlanRegistry plans;
+        STFT stft;
         Spectrogram spectrogram;
-        const uint32_t numBytes = NUM_SAMPLES * sizeof(float);
-        float *recordedSamples;
-        float *fftIn;
-        fftwf_plan p;
+        Waterfall waterfall;
+        bool showWaterfall = false;
+        std::vector<float> frameDB;
+        SampleFile capture;
         size_t sampleIdx = 0;
-        CircularBuffer<float> buf;
         Recorder recorder;
+        std::unique_ptr<ResampleChain> decimator;
+        std::unique_ptr<CaptureWriter> writer;
+        std::unique_ptr<SlidingDFT> tracker;
+        std::vector<float> trackedDB;
+        std::unique_ptr<SpectrumAverager> averager;
+        std::unique_ptr<ConstantQ> constantQ;
+        FrameArena arena;
+        Pipeline pipeline;
+        StatsOverlay statsOverlay;
+        StatsOverlay trackOverlay;
+        bool showStats = false;
+        TimePoint lastStatsRefresh;
+        TimePoint lastStatsLog;
+        std::ofstream statsLog;
 };
 
-App::App()
-    : window(sf::VideoMode({WIN_WIDTH, WIN_HEIGHT}), "Spectrogram"),
-      out((fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * FFT_SIZE)),
-      spectrogram(&window, out, FFT_SIZE, FUND_FREQ, sf::Vector2f(0, 0), sf::Vector2f(WIN_WIDTH, WIN_HEIGHT), sf::Vector2f(-80, 0)),
-      buf(FFT_SIZE),
-      recorder(FFT_SIZE)
+App::App(const Config &_config)
+    : config(_config),
+      window(sf::VideoMode({config.width, config.height}), "Spectrogram"),
+      stft(plans, config.fftSize, config.hopSize, config.window),
+      spectrogram(&window, stft.latestFrame(), config.fftSize, config.fundFreq(), sf::Vector2f(0, 0),
+                  sf::Vector2f(config.width, config.height), sf::Vector2f(config.dBMin, config.dBMax)),
+      waterfall(&window, config.fftSize, config.fundFreq(), sf::Vector2f(0, 0),
+                sf::Vector2f(config.width, config.height), sf::Vector2f(config.dBMin, config.dBMax)),
+      frameDB(config.fftSize/2 + 1),
+      recorder(config.fftSize, config.numChannels, config.inputDevice(), config.captureRate, config.framesPerBuffer,
+               config.sampleFormat),
+      constantQ(config.cqBins > 0 ? std::make_unique<ConstantQ>(plans, config.sampleRate, config.cqMin, config.cqBins) : nullptr),
+      arena(config.hugePages),
+      pipeline(plans, recorder, analysisSize(), config.hopSize, config.window, config.dspWorkers, 16, config.channel,
+               &arena),
+      statsOverlay(&window, sf::Vector2f(60, 10)),
+      trackOverlay(&window, sf::Vector2f((float) config.width - TRACK_OVERLAY_WIDTH, 10))
 {
-    recordedSamples = nullptr;
-    fftIn = (float*) fftwf_malloc(sizeof(float) *FFT_SIZE);
-    p = fftwf_plan_dft_r2c_1d(FFT_SIZE, fftIn, out, FFTW_ESTIMATE);
+    plans.prewarm(PREWARM_FFT_SIZES);
+    if (config.source.type != SourceType::PortAudio) {
+        recorder.setSource(makeSource(config.source, paNoDevice, config.speed));
+    }
+    if (!config.trackFreqs.empty()) {
+        std::vector<uint32_t> bins;
+        for (float freq : config.trackFreqs) bins.push_back(SlidingDFT::binFor(freq, config.sampleRate, config.fftSize));
+        tracker = std::make_unique<SlidingDFT>(config.fftSize, bins, config.window);
+        trackedDB.resize(bins.size());
+        pipeline.setTracker(tracker.get());
+    }
+    uint32_t numBins = config.fftSize/2 + 1;
+    if (constantQ) {
+        pipeline.setConstantQ(constantQ.get());
+        spectrogram.setAxis(constantQ->axis());
+        waterfall.setAxis(constantQ->axis());
+        numBins = constantQ->getNumBins();
+        frameDB.resize(numBins);
+    } else if (config.logAxis) {
+        spectrogram.setAxis(FrequencyAxis::fft(numBins, config.fundFreq(), true));
+        waterfall.setAxis(FrequencyAxis::fft(numBins, config.fundFreq(), true));
+    }
+    if (config.average.mode != AverageMode::None) {
+        averager = std::make_unique<SpectrumAverager>(numBins, config.average.mode, config.average.param);
+        pipeline.setAverager(averager.get());
+    }
 }
 
 void App::run() {
 
     while (window.isOpen()) {
         handleEvents();
-        if (recorder.readBlock(fftIn, FFT_SIZE)) {
-            fftwf_execute(p);
-            window.clear();
-            spectrogram.drawBars();
-            spectrogram.drawAxis();
-            window.display();
+
+        // Sleeps on the pipeline until a spectrum is ready
+        SpectrumFrame *frame = pipeline.acquireLatest(std::chrono::microseconds(RENDER_WAIT_US));
+        if (frame != nullptr) {
+            drawSpectrum(frame->dB);
+            pipeline.release(frame);
         }
+        updateStats();
     }
 }
 
+// Refreshes the overlay text and appends to the stats log on their own
+// intervals, so neither costs anything per frame
+void App::updateStats() {
+    TimePoint now = std::chrono::steady_clock::now();
+    if (showStats && now - lastStatsRefresh >= std::chrono::milliseconds(STATS_REFRESH_MS)) {
+        std::ostringstream ss;
+        pipeline.writeStats(ss);
+        statsOverlay.setText(ss.str());
+        lastStatsRefresh = now;
+    }
+    if (statsLog.is_open() && now - lastStatsLog >= std::chrono::seconds(STATS_LOG_SECONDS)) {
+        statsLog << "# " << std::time(nullptr) << std::endl;
+        pipeline.writeStats(statsLog);
+        statsLog.flush();
+        lastStatsLog = now;
+    }
+    // Cheap enough to refresh every pass, which keeps detection latency at
+    // one render wait
+    if (tracker && pipeline.trackedLevels(trackedDB.data())) {
+        std::ostringstream ss;
+        ss << std::fixed << std::setprecision(1);
+        for (uint32_t i = 0; i < trackedDB.size(); i++) {
+            if (i > 0) ss << std::endl;
+            ss << std::setw(8) << tracker->getBin(i)*config.fundFreq() << " Hz " << std::setw(6) << trackedDB[i] << " dB";
+        }
+        trackOverlay.setText(ss.str());
+    }
+}
+
+// Samples per analysis window: the constant-Q transform's FFT when enabled
+uint32_t App::analysisSize() const {
+    return constantQ ? constantQ->getFFTSize() : config.fftSize;
+}
+
+// `samples` holds analysisSize() samples
+void App::drawFrame(const float *samples) {
+    if (constantQ) {
+        constantQ->analyze(samples, frameDB.data());
+    } else {
+        stft.analyze(samples);
+        spectrumToDB(stft.latestFrame(), frameDB.data(), frameDB.size(), amplitudeScale(config.fftSize));
+    }
+    drawSpectrum(frameDB.data());
+}
+
+// History always accumulates so switching views keeps the waterfall intact
+void App::drawSpectrum(const float *dB) {
+    waterfall.pushFrame(dB);
+    window.clear();
+    if (showWaterfall) {
+        waterfall.draw();
+    } else {
+        spectrogram.drawBars(dB);
+        spectrogram.drawAxis();
+    }
+    if (showStats) statsOverlay.draw();
+    if (tracker) trackOverlay.draw();
+    window.display();
+}
+
 void App::handleEvents() {
     while (const std::optional event = window.pollEvent()) {
         if (event->is<sf::Event::Closed>()) {
             window.close();
             break;
+        } else if (const sf::Event::Resized *resized = event->getIf<sf::Event::Resized>()) {
+            sf::Vector2f newSize(resized->size);
+            window.setView(sf::View(sf::FloatRect({0, 0}, newSize)));
+            spectrogram.setSize(newSize);
+            waterfall.setSize(newSize);
         } else if (const sf::Event::KeyPressed *keyPressed = event->getIf<sf::Event::KeyPressed>()) {
             if (keyPressed->code == sf::Keyboard::Key::N) {
-                if (recordedSamples == nullptr) continue;
-                if (sampleIdx + FFT_SIZE >= NUM_SAMPLES) continue;
-                for (size_t i = 0; i < FFT_SIZE; i++) {
-                    buf.write(recordedSamples[sampleIdx++]);
-                }
-                buf.readBlock(fftIn, FFT_SIZE);
-                fftwf_execute(p);
-                spectrogram.clearBars(sf::Color::Black);
-                spectrogram.drawBars();
-                window.display();
+                const float *frame = capture.view(sampleIdx, analysisSize());
+                if (frame == nullptr) continue;
+                sampleIdx += config.hopSize;
+                drawFrame(frame);
             } else if (keyPressed->code == sf::Keyboard::Key::P) {
-                if (recordedSamples == nullptr) continue;
-                if (sampleIdx < 2*FFT_SIZE) continue;
-                sampleIdx -= 2*FFT_SIZE;
-                for (size_t i = 0; i < FFT_SIZE; i++) {
-                    buf.write(recordedSamples[sampleIdx++]);
-                }
-                buf.readBlock(fftIn, FFT_SIZE);
-                fftwf_execute(p);
-                spectrogram.clearBars(sf::Color::Black);
-                spectrogram.drawBars();
-                window.display();
+                if (sampleIdx < 2*config.hopSize) continue;
+                const float *frame = capture.view(sampleIdx - 2*config.hopSize, analysisSize());
+                if (frame == nullptr) continue;
+                sampleIdx -= config.hopSize;
+                drawFrame(frame);
+            } else if (keyPressed->code == sf::Keyboard::Key::W) {
+                showWaterfall = !showWaterfall;
+            } else if (keyPressed->code == sf::Keyboard::Key::S) {
+                showStats = !showStats;
+                lastStatsRefresh = TimePoint();
             } else if (keyPressed->code == sf::Keyboard::Key::R) {
-                recorder.start();
+                if (pipeline.isRunning()) continue;
+                // The writer's tap has to exist before the stream opens
+                if (!config.record.empty() && !writer) {
+                    writer = std::make_unique<CaptureWriter>(recorder, config.record,
+                                                             (uint64_t) config.rotateMB << 20, config.rotateSeconds);
+                }
+                if (recorder.start()) {
+                    if (writer) writer->start();
+                    if (recorder.getSampleRate() != config.sampleRate) {
+                        decimator = std::make_unique<ResampleChain>(recorder.getSampleRate());
+                        decimator->addResampler(config.sampleRate);
+                        pipeline.setInputStage(decimator.get());
+                    }
+                    pipeline.start();
+                    if (!statsLog.is_open()) statsLog.open(STATS_LOG_FILE, std::ios::app);
+                    if (!statsLog.is_open()) std::cout << "Failed to open " << STATS_LOG_FILE << std::endl;
+                    lastStatsLog = std::chrono::steady_clock::now();
+                }
             }
         }
     }
 }
 
 void App::readSamples(const char *filename) {
-    FILE *fid = fopen(filename, "rb");
-    recordedSamples = (float*) malloc(sizeof(float)*numBytes);
-    size_t retCode = fread(recordedSamples, sizeof(float), TOTAL_FRAMES, fid);
-    if (retCode == TOTAL_FRAMES) {
-        std::cout << "Array read " << TOTAL_FRAMES << " frames successfully" << std::endl;
-    } else {
-        std::cout << "Failed to read \'" << filename << "\' (" << retCode << ")" << std::endl;
+    sampleIdx = 0;
+    if (!capture.open(filename, config.numChannels, config.sampleRate)) return;
+    if (capture.getChannels() != 1) {
+        std::cout << "Only mono captures can be displayed (\'" << filename << "\' has "
+                  << capture.getChannels() << " channels)" << std::endl;
+        capture.close();
     }
 }
 
 App::~App() {
-    fftwf_destroy_plan(p);
-    fftwf_free(fftIn);
-    fftwf_free(out);
-    free(recordedSamples);
+    if (pipeline.isRunning()) {
+        pipeline.stop();
+        pipeline.printStats();
+    }
+    if (writer) {
+        recorder.stop();
+        writer->stop();
+        std::cout << "Recorded " << writer->getFramesWritten() << " frames to " << writer->getFilesWritten()
+                  << " file(s), " << writer->getDropped() << " dropped"
+                  << (writer->hasFailed() ? ", stopped early by a write error" : "") << std::endl;
+    }
 }
 
 #endif
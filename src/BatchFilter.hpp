@@ -0,0 +1,333 @@
+#ifndef BATCH_FILTER_H
+#define BATCH_FILTER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Biquad.hpp"
+#include "Deinterleave.hpp"
+#include "SampleFile.hpp"
+#include "WorkStealingPool.hpp"
+
+#define FILTER_BLOCK_SAMPLES (1 << 14)  // 64 KB of a channel group gathered and filtered at a time, stays in L2
+#define FILTER_WINDOW_SAMPLES (1 << 21) // 8 MB of planar scratch per file between interleaving passes
+
+// One stage of the cascade, designed at each file's own sample rate
+struct FilterSection {
+    BiquadType type;
+    float f0;
+    float q;
+    float gainDB;
+};
+
+// Offline biquad cascade over whole captures on a WorkStealingPool. Filter
+// state has to run through a channel's samples in order, but channels and
+// files do not depend on each other. Files are processed a window of
+// FILTER_WINDOW_SAMPLES at a time in two passes:
+//  - one task per group of channels (up to one group per thread) gathers
+//    its channels from the interleaved input block by block into planar
+//    scratch and filters them there, carrying each channel's state on to
+//    the next window
+//  - the window is then split into frame ranges, each interleaved into the
+//    mapped output by one task, so no two threads write the same region
+// Mono files skip the scratch and are filtered straight into the output.
+// Output keeps the input's sample format, so a 16-bit WAV is read and
+// written as Q15 and only converted to float a block at a time. A .wav
+// output gets a WAV header and anything else none, like recorded.raw.
+class BatchFilter {
+    public:
+        BatchFilter(uint32_t numThreads = 0);
+        BatchFilter(const BatchFilter&) = delete;
+        BatchFilter& operator=(const BatchFilter&) = delete;
+        ~BatchFilter();
+
+        void addSection(const FilterSection &section);
+        bool addFile(const std::string &input, const std::string &output, uint32_t rawChannels, uint32_t rawSampleRate);
+        void run();
+
+        uint64_t getSamplesFiltered() const;
+        uint32_t getNumThreads() const;
+        uint64_t getSteals() const;
+    private:
+        struct Job {
+            SampleFile input;
+            std::string output;
+            uint8_t *map = nullptr;     // output file
+            size_t mapSize = 0;
+            float *samples = nullptr;   // float output
+            int16_t *pcm16 = nullptr;   // or Q15 output
+            std::vector<BiquadCascade> cascades;    // one per channel
+            std::vector<float> planar;              // windowFrames per channel
+            uint32_t windowFrames = 0;
+            uint64_t done = 0;                      // frames filtered in earlier windows
+        };
+
+        void filterChannels(Job &job, uint32_t first, uint32_t last, uint64_t frame, uint32_t count);
+        void interleave(Job &job, uint64_t frame, uint32_t from, uint32_t count);
+        bool writeEmpty(const std::string &output, bool wav, uint32_t channels, uint32_t sampleRate,
+                        SampleFormat format = SampleFormat::Float32);
+
+        WorkStealingPool pool;
+        std::vector<FilterSection> sections;
+        std::vector<std::unique_ptr<Job>> jobs;
+        std::atomic<uint64_t> samplesFiltered{0};
+};
+
+BatchFilter::BatchFilter(uint32_t numThreads)
+    : pool(numThreads)
+{ }
+
+BatchFilter::~BatchFilter() {
+    for (std::unique_ptr<Job> &job : jobs) {
+        if (job->map != nullptr) munmap(job->map, job->mapSize);
+    }
+}
+
+void BatchFilter::addSection(const FilterSection &section) {
+    sections.push_back(section);
+}
+
+// Maps `input` and creates `output` at its final size. An input without
+// frames gets its empty output here and no task.
+bool BatchFilter::addFile(const std::string &input, const std::string &output, uint32_t rawChannels, uint32_t rawSampleRate) {
+    bool wav = output.size() >= 4 && strcasecmp(output.c_str() + output.size() - 4, ".wav") == 0;
+
+    // Truncating the input while it is mapped would fault on every read
+    struct stat in, out;
+    bool haveInput = stat(input.c_str(), &in) == 0;
+    if (haveInput && stat(output.c_str(), &out) == 0 && in.st_dev == out.st_dev && in.st_ino == out.st_ino) {
+        std::cout << "Failed to filter \'" << input << "\' in place, choose another output" << std::endl;
+        return false;
+    }
+    // Neither an empty raw file nor an empty output can be mapped
+    if (haveInput && in.st_size == 0) return writeEmpty(output, wav, rawChannels == 0 ? 1 : rawChannels, rawSampleRate);
+
+    std::unique_ptr<Job> job = std::make_unique<Job>();
+    if (!job->input.open(input.c_str(), rawChannels, rawSampleRate)) return false;
+    for (const FilterSection &section : sections) {
+        if (section.f0 <= 0 || section.f0 >= job->input.getSampleRate()/2.0f) {
+            std::cout << "Filter frequency " << section.f0 << " Hz is outside (0, "
+                      << job->input.getSampleRate()/2 << ") for \'" << input << "\'" << std::endl;
+            return false;
+        }
+    }
+
+    if (job->input.getNumFrames() == 0) {
+        return writeEmpty(output, wav, job->input.getChannels(), job->input.getSampleRate(), job->input.getFormat());
+    }
+
+    size_t headerSize = wav ? WAV_HEADER_BYTES : 0;
+    SampleFormat format = job->input.getFormat();
+    size_t dataSize = sampleBytes(format) * job->input.getNumFrames() * job->input.getChannels();
+    if (wav && dataSize > UINT32_MAX - WAV_HEADER_BYTES) {
+        std::cout << "Failed to write \'" << output << "\', too large for a WAV file" << std::endl;
+        return false;
+    }
+
+    int fd = ::open(output.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cout << "Failed to open \'" << output << "\'" << std::endl;
+        return false;
+    }
+    job->mapSize = headerSize + dataSize;
+    void *addr = MAP_FAILED;
+    if (ftruncate(fd, job->mapSize) == 0) addr = mmap(nullptr, job->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) {
+        std::cout << "Failed to map \'" << output << "\'" << std::endl;
+        return false;
+    }
+    job->map = (uint8_t*) addr;
+    if (format == SampleFormat::Int16) job->pcm16 = (int16_t*) (job->map + headerSize);
+    else job->samples = (float*) (job->map + headerSize);
+    job->output = output;
+    uint32_t channels = job->input.getChannels();
+    job->cascades.resize(channels);
+    for (BiquadCascade &cascade : job->cascades) {
+        for (const FilterSection &section : sections) {
+            cascade.addSection(BiquadCoeffs::design(section.type, job->input.getSampleRate(), section.f0, section.q, section.gainDB));
+        }
+    }
+    if (channels > 1) {
+        job->windowFrames = std::max<uint32_t>(FILTER_WINDOW_SAMPLES/channels, 1);
+        if (job->windowFrames > job->input.getNumFrames()) job->windowFrames = job->input.getNumFrames();
+    } else {
+        job->windowFrames = FILTER_WINDOW_SAMPLES;
+    }
+    if (wav) makeWavHeader(job->map, job->input.getChannels(), job->input.getSampleRate(), dataSize, format);
+
+    jobs.push_back(std::move(job));
+    return true;
+}
+
+// Nothing to filter: just the header for a .wav, an empty file otherwise
+bool BatchFilter::writeEmpty(const std::string &output, bool wav, uint32_t channels, uint32_t sampleRate,
+                             SampleFormat format) {
+    int fd = ::open(output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cout << "Failed to open \'" << output << "\'" << std::endl;
+        return false;
+    }
+    bool ok = true;
+    if (wav) {
+        uint8_t header[WAV_HEADER_BYTES];
+        makeWavHeader(header, channels, sampleRate, 0, format);
+        ok = ::write(fd, header, WAV_HEADER_BYTES) == WAV_HEADER_BYTES;
+        if (!ok) std::cout << "Failed to write WAV header to \'" << output << "\'" << std::endl;
+    }
+    ::close(fd);
+    return ok;
+}
+
+// Filters every added file, largest first for the best balance
+void BatchFilter::run() {
+    std::vector<Job*> order;
+    for (std::unique_ptr<Job> &job : jobs) order.push_back(job.get());
+    std::stable_sort(order.begin(), order.end(), [](const Job *a, const Job *b) {
+        return a->input.getNumFrames()*a->input.getChannels() > b->input.getNumFrames()*b->input.getChannels();
+    });
+    uint32_t threads = pool.getNumThreads();
+
+    while (true) {
+        std::vector<Job*> active;
+        for (Job *job : order) {
+            if (job->done < job->input.getNumFrames()) active.push_back(job);
+        }
+        if (active.empty()) break;
+
+        for (Job *job : active) {
+            uint64_t frame = job->done;
+            uint32_t count = std::min<uint64_t>(job->windowFrames, job->input.getNumFrames() - frame);
+            uint32_t channels = job->input.getChannels();
+            // Scratch only lives while the file is being filtered
+            if (channels > 1 && job->planar.empty()) job->planar.resize((size_t) job->windowFrames*channels);
+            uint32_t groups = std::min(channels, threads);
+            for (uint32_t g = 0; g < groups; g++) {
+                uint32_t first = channels*g/groups, last = channels*(g + 1)/groups;
+                pool.submit([this, job, first, last, frame, count]() { filterChannels(*job, first, last, frame, count); });
+            }
+        }
+        pool.run();
+
+        bool interleaving = false;
+        for (Job *job : active) {
+            uint64_t frame = job->done;
+            uint32_t count = std::min<uint64_t>(job->windowFrames, job->input.getNumFrames() - frame);
+            job->done += count;
+            if (job->input.getChannels() == 1) continue;
+            // Ranges of whole 16-frame runs, so neighbours rarely share a cache line
+            uint32_t step = (count/threads + 15)/16*16;
+            if (step == 0) step = count;
+            for (uint32_t from = 0; from < count; from += step) {
+                uint32_t n = std::min(step, count - from);
+                pool.submit([this, job, frame, from, n]() { interleave(*job, frame, from, n); });
+                interleaving = true;
+            }
+        }
+        if (interleaving) pool.run();
+        for (Job *job : active) {
+            if (job->done == job->input.getNumFrames()) std::vector<float>().swap(job->planar);
+        }
+    }
+}
+
+// Channels [first, last) of the `count` frames from `frame`, into the
+// job's planar scratch (or the output, for mono files)
+void BatchFilter::filterChannels(Job &job, uint32_t first, uint32_t last, uint64_t frame, uint32_t count) {
+    const SampleFile &input = job.input;
+    uint32_t channels = input.getChannels();
+    bool q15 = job.pcm16 != nullptr;
+
+    if (channels == 1) {
+        // Q15 is filtered in place in the converted block and then stored
+        std::vector<float> converted(q15 ? FILTER_BLOCK_SAMPLES : 0);
+        for (uint32_t f = 0; f < count; f += FILTER_BLOCK_SAMPLES) {
+            uint32_t n = std::min<uint32_t>(FILTER_BLOCK_SAMPLES, count - f);
+            input.prefetch(frame + f + n, FILTER_BLOCK_SAMPLES);
+            const float *src = input.read(frame + f, n, converted.data());
+            if (q15) {
+                job.cascades[0].processBlock(src, converted.data(), n);
+                floatToQ15(converted.data(), &job.pcm16[frame + f], n);
+            } else {
+                job.cascades[0].processBlock(src, &job.samples[frame + f], n);
+            }
+            // Nothing else reads this range again
+            input.release(frame + f, n);
+        }
+        samplesFiltered.fetch_add(count, std::memory_order_relaxed);
+        return;
+    }
+
+    uint32_t width = last - first;
+    // Converting Q15 takes every channel of a block, so those blocks are
+    // sized by all of them
+    uint32_t blockFrames = std::max<uint32_t>(FILTER_BLOCK_SAMPLES/(q15 ? channels : width), 1);
+    std::vector<float*> planes(channels);
+    std::vector<float> converted(q15 ? (size_t) blockFrames*channels : 0);
+    for (uint32_t f = 0; f < count; f += blockFrames) {
+        uint32_t n = std::min(blockFrames, count - f);
+        input.prefetch(frame + f + n, blockFrames);
+        const float *src = input.read(frame + f, n, converted.data());
+        for (uint32_t c = 0; c < channels; c++) planes[c] = &job.planar[(size_t) c*job.windowFrames + f];
+
+        if (width == channels) {
+            deinterleave(src, planes.data(), channels, n);
+        } else {
+            for (uint32_t i = 0; i < n; i++) {
+                for (uint32_t c = first; c < last; c++) planes[c][i] = src[i*channels + c];
+            }
+        }
+        for (uint32_t c = first; c < last; c++) job.cascades[c].processBlock(planes[c], planes[c], n);
+    }
+    samplesFiltered.fetch_add((uint64_t) count*width, std::memory_order_relaxed);
+}
+
+// Frames [from, from + count) of the window starting at `frame`, from the
+// planar scratch into the output
+void BatchFilter::interleave(Job &job, uint64_t frame, uint32_t from, uint32_t count) {
+    uint32_t channels = job.input.getChannels();
+    if (job.pcm16 == nullptr) {
+        float *dst = &job.samples[(frame + from)*channels];
+        for (uint32_t i = 0; i < count; i++) {
+            for (uint32_t c = 0; c < channels; c++) dst[i*channels + c] = job.planar[(size_t) c*job.windowFrames + from + i];
+        }
+    } else {
+        // Interleaved a block at a time, then stored as Q15
+        uint32_t blockFrames = std::max<uint32_t>(FILTER_BLOCK_SAMPLES/channels, 1);
+        std::vector<float> block((size_t) blockFrames*channels);
+        for (uint32_t f = 0; f < count; f += blockFrames) {
+            uint32_t n = std::min(blockFrames, count - f);
+            for (uint32_t i = 0; i < n; i++) {
+                for (uint32_t c = 0; c < channels; c++) block[i*channels + c] = job.planar[(size_t) c*job.windowFrames + from + f + i];
+            }
+            floatToQ15(block.data(), &job.pcm16[(frame + from + f)*channels], n*channels);
+        }
+    }
+    // Every channel group is done with this range
+    job.input.release(frame + from, count);
+}
+
+uint64_t BatchFilter::getSamplesFiltered() const {
+    return samplesFiltered.load(std::memory_order_relaxed);
+}
+
+uint32_t BatchFilter::getNumThreads() const {
+    return pool.getNumThreads();
+}
+
+uint64_t BatchFilter::getSteals() const {
+    return pool.getSteals();
+}
+
+#endif
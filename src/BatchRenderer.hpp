@@ -0,0 +1,208 @@
+#ifndef BATCH_RENDERER_H
+#define BATCH_RENDERER_H
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <SFML/Graphics/Image.hpp>
+
+#include "DBKernel.hpp"
+#include "PlanRegistry.hpp"
+#include "SampleFile.hpp"
+#include "STFT.hpp"
+
+#define RENDER_BATCH_FRAMES 64
+
+enum class RenderFormat {
+    NPY,    // float32 (frames, bins) matrix readable by numpy.load
+    Raw,    // same matrix without a header
+    PNG     // grayscale image, time left to right, low frequencies at the bottom
+};
+
+// Offline spectrogram of a whole capture without a window. Every STFT frame
+// only depends on its input samples, so the frame range is split evenly
+// across threads and each thread writes its rows straight to their final
+// offset in the output file.
+class BatchRenderer {
+    public:
+        BatchRenderer(PlanRegistry &plans, uint32_t fftSize, uint32_t hopSize,
+                      WindowType windowType = WindowType::Hann, uint32_t numThreads = 0,
+                      sf::Vector2f dBRange = sf::Vector2f(-80, 0));
+        bool render(const SampleFile &capture, const std::string &outFile, uint32_t channel = 0);
+        static RenderFormat formatFor(const std::string &filename);
+        uint64_t getFramesRendered() const;
+    private:
+        void renderRange(const SampleFile &capture, uint32_t channel, uint64_t firstFrame, uint64_t lastFrame,
+                         int fd, uint64_t dataOffset, float *image);
+        uint64_t writeNpyHeader(int fd, uint64_t numFrames);
+        bool writePng(const std::string &outFile, const float *image, uint64_t numFrames);
+
+        PlanRegistry &plans;
+        uint32_t fftSize, hopSize, numBins, numThreads;
+        WindowType windowType;
+        sf::Vector2f dBRange;
+        uint64_t framesRendered = 0;
+        std::atomic<bool> failed{false};    // set by the header write or any worker
+};
+
+BatchRenderer::BatchRenderer(PlanRegistry &_plans, uint32_t _fftSize, uint32_t _hopSize,
+                             WindowType _windowType, uint32_t _numThreads, sf::Vector2f _dBRange)
+    : plans(_plans),
+      fftSize(_fftSize),
+      hopSize(_hopSize == 0 ? _fftSize : _hopSize),
+      numBins(_fftSize/2 + 1),
+      numThreads(_numThreads != 0 ? _numThreads : std::thread::hardware_concurrency()),
+      windowType(_windowType),
+      dBRange(_dBRange)
+{
+    if (numThreads == 0) numThreads = 1;
+}
+
+RenderFormat BatchRenderer::formatFor(const std::string &filename) {
+    auto endsWith = [&filename](const char *ext) {
+        size_t len = strlen(ext);
+        return filename.size() >= len && filename.compare(filename.size() - len, len, ext) == 0;
+    };
+    if (endsWith(".png")) return RenderFormat::PNG;
+    if (endsWith(".npy")) return RenderFormat::NPY;
+    return RenderFormat::Raw;
+}
+
+bool BatchRenderer::render(const SampleFile &capture, const std::string &outFile, uint32_t channel) {
+    framesRendered = 0;
+    failed = false;
+    if (!capture.isOpen() || capture.getNumFrames() < fftSize || channel >= capture.getChannels()) {
+        std::cout << "Nothing to render" << std::endl;
+        return false;
+    }
+    uint64_t numFrames = (capture.getNumFrames() - fftSize)/hopSize + 1;
+    RenderFormat format = formatFor(outFile);
+
+    int fd = -1;
+    uint64_t dataOffset = 0;
+    std::vector<float> image;
+    if (format == RenderFormat::PNG) {
+        image.resize(numFrames * numBins);
+    } else {
+        fd = ::open(outFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            std::cout << "Failed to open \'" << outFile << "\'" << std::endl;
+            return false;
+        }
+        if (format == RenderFormat::NPY) dataOffset = writeNpyHeader(fd, numFrames);
+        if (failed) {
+            ::close(fd);
+            return false;
+        }
+    }
+
+    std::vector<std::thread> workers;
+    uint32_t threads = numFrames < numThreads ? (uint32_t) numFrames : numThreads;
+    for (uint32_t t = 0; t < threads; t++) {
+        uint64_t first = numFrames*t/threads;
+        uint64_t last = numFrames*(t + 1)/threads;
+        workers.emplace_back(&BatchRenderer::renderRange, this, std::cref(capture), channel,
+                             first, last, fd, dataOffset, image.empty() ? nullptr : image.data());
+    }
+    for (std::thread &worker : workers) worker.join();
+
+    bool ok = true;
+    if (fd >= 0) {
+        ok = ::close(fd) == 0 && !failed;
+    } else {
+        ok = !failed && writePng(outFile, image.data(), numFrames);
+    }
+    if (ok) framesRendered = numFrames;
+    return ok;
+}
+
+void BatchRenderer::renderRange(const SampleFile &capture, uint32_t channel, uint64_t firstFrame,
+                                uint64_t lastFrame, int fd, uint64_t dataOffset, float *image) {
+    STFT stft(plans, fftSize, hopSize, windowType, 1);
+    const uint32_t channels = capture.getChannels();
+    std::vector<float> mono(channels > 1 ? fftSize : 0);
+    std::vector<float> converted(capture.getFormat() == SampleFormat::Int16 ? (size_t) fftSize * channels : 0);
+    std::vector<float> rows(RENDER_BATCH_FRAMES * numBins);
+
+    for (uint64_t batch = firstFrame; batch < lastFrame && !failed; batch += RENDER_BATCH_FRAMES) {
+        uint64_t batchEnd = batch + RENDER_BATCH_FRAMES < lastFrame ? batch + RENDER_BATCH_FRAMES : lastFrame;
+        float *out = image != nullptr ? &image[batch * numBins] : rows.data();
+        capture.prefetch(batchEnd * hopSize, RENDER_BATCH_FRAMES * hopSize + fftSize);
+
+        for (uint64_t f = batch; f < batchEnd; f++) {
+            const float *frame = capture.read(f * hopSize, fftSize, converted.data());
+            if (channels > 1) {
+                for (uint32_t i = 0; i < fftSize; i++) mono[i] = frame[i*channels + channel];
+                frame = mono.data();
+            }
+            stft.analyze(frame);
+
+            spectrumToDB(stft.latestFrame(), &out[(f - batch) * numBins], numBins, amplitudeScale(fftSize));
+        }
+
+        if (fd >= 0) {
+            size_t bytes = sizeof(float) * (batchEnd - batch) * numBins;
+            off_t offset = dataOffset + sizeof(float) * batch * numBins;
+            if (pwrite(fd, out, bytes, offset) != (ssize_t) bytes) {
+                std::cerr << "Short write at frame " << batch << ": " << strerror(errno) << std::endl;
+                failed = true;
+                return;
+            }
+        }
+    }
+}
+
+// NPY version 1.0 header, padded so the data starts 64-byte aligned. Sets
+// `failed` if it could not be written.
+uint64_t BatchRenderer::writeNpyHeader(int fd, uint64_t numFrames) {
+    std::string dict = "{'descr': '<f4', 'fortran_order': False, 'shape': ("
+        + std::to_string(numFrames) + ", " + std::to_string(numBins) + "), }";
+    size_t headerLen = 10 + dict.size() + 1;
+    size_t padded = (headerLen + 63)/64*64;
+    dict.append(padded - headerLen, ' ');
+    dict.push_back('\n');
+
+    std::string header("\x93NUMPY\x01\x00", 8);
+    uint16_t dictLen = dict.size();
+    header.push_back((char) (dictLen & 0xff));
+    header.push_back((char) (dictLen >> 8));
+    header += dict;
+    if (write(fd, header.data(), header.size()) != (ssize_t) header.size()) {
+        std::cerr << "Failed to write NPY header: " << strerror(errno) << std::endl;
+        failed = true;
+        return 0;
+    }
+    return header.size();
+}
+
+bool BatchRenderer::writePng(const std::string &outFile, const float *image, uint64_t numFrames) {
+    sf::Image png(sf::Vector2u((unsigned) numFrames, numBins), sf::Color::Black);
+    for (uint64_t f = 0; f < numFrames; f++) {
+        for (uint32_t i = 0; i < numBins; i++) {
+            float dB = image[f*numBins + i];
+            if (dB < dBRange.x) dB = dBRange.x; // clamp to min
+            if (dB > dBRange.y) dB = dBRange.y; // clamp to max
+            uint8_t level = (uint8_t) (255*(dB - dBRange.x)/(dBRange.y - dBRange.x));
+            png.setPixel(sf::Vector2u((unsigned) f, numBins - 1 - i), sf::Color(level, level, level));
+        }
+    }
+    if (!png.saveToFile(outFile)) {
+        std::cout << "Failed to write \'" << outFile << "\'" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+uint64_t BatchRenderer::getFramesRendered() const {
+    return framesRendered;
+}
+
+#endif
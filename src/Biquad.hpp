@@ -2,15 +2,341 @@
 #define BIQUAD_H
 
 #include <cstdint>
+#include <cmath>
+#include <cstring>
+#include <vector>
 
-class ABiquad {
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#define BIQUAD_LANES 8
+
+// RBJ audio EQ cookbook filter shapes
+enum class BiquadType {
+    LowPass,
+    HighPass,
+    BandPass,
+    Notch,
+    Peak,
+    LowShelf,
+    HighShelf
+};
+
+bool parseBiquadType(const char *name, BiquadType &type) {
+    if (strcmp(name, "lowpass") == 0) type = BiquadType::LowPass;
+    else if (strcmp(name, "highpass") == 0) type = BiquadType::HighPass;
+    else if (strcmp(name, "bandpass") == 0) type = BiquadType::BandPass;
+    else if (strcmp(name, "notch") == 0) type = BiquadType::Notch;
+    else if (strcmp(name, "peak") == 0) type = BiquadType::Peak;
+    else if (strcmp(name, "lowshelf") == 0) type = BiquadType::LowShelf;
+    else if (strcmp(name, "highshelf") == 0) type = BiquadType::HighShelf;
+    else return false;
+    return true;
+}
+
+// Coefficients normalized by a0 so the per-sample path has no divides
+struct BiquadCoeffs {
+    float b0, b1, b2, a1, a2;
+
+    static BiquadCoeffs design(BiquadType type, uint32_t fs, float f0, float q, float gainDB = 0);
+};
+
+// Single transposed direct form II section
+class Biquad {
     public:
-        ABiquad(uint32_t fs, uint32_t f0, float q);
-        ~ABiquad();
+        Biquad(BiquadType type, uint32_t fs, float f0, float q, float gainDB = 0);
+        Biquad(const BiquadCoeffs &coeffs);
+        float process(float x);
+        void processBlock(const float *input, float *output, uint32_t n);
+        void reset();
+        const BiquadCoeffs& getCoeffs() const;
+    protected:
+        BiquadCoeffs c;
+        float s1, s2;
+};
+
+// N sections in series. Each section runs over the whole block before the
+// next one so its coefficients and state stay in registers.
+class BiquadCascade {
+    public:
+        BiquadCascade() = default;
+        void addSection(const BiquadCoeffs &coeffs);
+        void processBlock(const float *input, float *output, uint32_t n);
+        void reset();
+        size_t numSections() const;
     private:
-        uint32_t fs, f0;
-        float q;
-        float a0, a1, a2, b0, b1, b2;
+        std::vector<BiquadCoeffs> coeffs;
+        std::vector<float> state; // s1, s2 per section
 };
 
+// BIQUAD_LANES independent cascades evaluated in parallel SIMD lanes. Each
+// lane has its own coefficients, so this serves both as an 8-channel filter
+// (interleaved frames) and as an 8-filter bank over one signal.
+class BiquadCascadeX8 {
+    public:
+        BiquadCascadeX8(uint32_t numSections);
+        void setSection(uint32_t section, uint32_t lane, const BiquadCoeffs &coeffs);
+        void processBlock(const float *input, float *output, uint32_t n);
+        void processBank(const float *input, float *output, uint32_t n);
+        void reset();
+        uint32_t numSections() const;
+    private:
+        struct Section {
+            alignas(32) float b0[BIQUAD_LANES];
+            alignas(32) float b1[BIQUAD_LANES];
+            alignas(32) float b2[BIQUAD_LANES];
+            alignas(32) float a1[BIQUAD_LANES];
+            alignas(32) float a2[BIQUAD_LANES];
+            alignas(32) float s1[BIQUAD_LANES];
+            alignas(32) float s2[BIQUAD_LANES];
+        };
+        void processSection(Section &s, float *data, uint32_t n);
+        std::vector<Section> sections;
+};
+
+BiquadCoeffs BiquadCoeffs::design(BiquadType type, uint32_t fs, float f0, float q, float gainDB) {
+    // Intermediate variables
+    double omega = 2*M_PI*f0/fs;
+    double cosOmega = cos(omega);
+    double sinOmega = sin(omega);
+    double alpha = sinOmega/(2*q);
+    double A = pow(10.0, gainDB/40.0);
+    double sqrtA2alpha = 2*sqrt(A)*alpha;
+
+    double a0, a1, a2, b0, b1, b2;
+    switch (type) {
+        case BiquadType::LowPass:
+            b0 = (1 - cosOmega)/2;
+            b1 = 1 - cosOmega;
+            b2 = b0;
+            a0 = 1 + alpha;
+            a1 = -2*cosOmega;
+            a2 = 1 - alpha;
+            break;
+        case BiquadType::HighPass:
+            b0 = (1 + cosOmega)/2;
+            b1 = -(1 + cosOmega);
+            b2 = b0;
+            a0 = 1 + alpha;
+            a1 = -2*cosOmega;
+            a2 = 1 - alpha;
+            break;
+        case BiquadType::BandPass: // constant 0 dB peak gain
+            b0 = alpha;
+            b1 = 0;
+            b2 = -alpha;
+            a0 = 1 + alpha;
+            a1 = -2*cosOmega;
+            a2 = 1 - alpha;
+            break;
+        case BiquadType::Notch:
+            b0 = 1;
+            b1 = -2*cosOmega;
+            b2 = 1;
+            a0 = 1 + alpha;
+            a1 = -2*cosOmega;
+            a2 = 1 - alpha;
+            break;
+        case BiquadType::Peak:
+            b0 = 1 + alpha*A;
+            b1 = -2*cosOmega;
+            b2 = 1 - alpha*A;
+            a0 = 1 + alpha/A;
+            a1 = -2*cosOmega;
+            a2 = 1 - alpha/A;
+            break;
+        case BiquadType::LowShelf:
+            b0 = A*((A + 1) - (A - 1)*cosOmega + sqrtA2alpha);
+            b1 = 2*A*((A - 1) - (A + 1)*cosOmega);
+            b2 = A*((A + 1) - (A - 1)*cosOmega - sqrtA2alpha);
+            a0 = (A + 1) + (A - 1)*cosOmega + sqrtA2alpha;
+            a1 = -2*((A - 1) + (A + 1)*cosOmega);
+            a2 = (A + 1) + (A - 1)*cosOmega - sqrtA2alpha;
+            break;
+        case BiquadType::HighShelf:
+        default:
+            b0 = A*((A + 1) + (A - 1)*cosOmega + sqrtA2alpha);
+            b1 = -2*A*((A - 1) + (A + 1)*cosOmega);
+            b2 = A*((A + 1) + (A - 1)*cosOmega - sqrtA2alpha);
+            a0 = (A + 1) - (A - 1)*cosOmega + sqrtA2alpha;
+            a1 = 2*((A - 1) - (A + 1)*cosOmega);
+            a2 = (A + 1) - (A - 1)*cosOmega - sqrtA2alpha;
+            break;
+    }
+
+    return BiquadCoeffs{(float) (b0/a0), (float) (b1/a0), (float) (b2/a0), (float) (a1/a0), (float) (a2/a0)};
+}
+
+Biquad::Biquad(BiquadType type, uint32_t fs, float f0, float q, float gainDB)
+    : c(BiquadCoeffs::design(type, fs, f0, q, gainDB)),
+      s1(0), s2(0)
+{ }
+
+Biquad::Biquad(const BiquadCoeffs &coeffs)
+    : c(coeffs),
+      s1(0), s2(0)
+{ }
+
+float Biquad::process(float x) {
+    float y = c.b0*x + s1;
+    s1 = c.b1*x - c.a1*y + s2;
+    s2 = c.b2*x - c.a2*y;
+    return y;
+}
+
+void Biquad::processBlock(const float *input, float *output, uint32_t n) {
+    // Work on locals so the compiler keeps state out of memory
+    const float b0 = c.b0, b1 = c.b1, b2 = c.b2, a1 = c.a1, a2 = c.a2;
+    float z1 = s1, z2 = s2;
+    for (uint32_t i = 0; i < n; i++) {
+        float x = input[i];
+        float y = b0*x + z1;
+        z1 = b1*x - a1*y + z2;
+        z2 = b2*x - a2*y;
+        output[i] = y;
+    }
+    s1 = z1;
+    s2 = z2;
+}
+
+void Biquad::reset() {
+    s1 = s2 = 0;
+}
+
+const BiquadCoeffs& Biquad::getCoeffs() const {
+    return c;
+}
+
+void BiquadCascade::addSection(const BiquadCoeffs &section) {
+    coeffs.push_back(section);
+    state.push_back(0);
+    state.push_back(0);
+}
+
+void BiquadCascade::processBlock(const float *input, float *output, uint32_t n) {
+    if (coeffs.empty()) {
+        if (output != input)
+            for (uint32_t i = 0; i < n; i++) output[i] = input[i];
+        return;
+    }
+
+    const float *src = input;
+    for (size_t k = 0; k < coeffs.size(); k++) {
+        const BiquadCoeffs &c = coeffs[k];
+        float z1 = state[2*k], z2 = state[2*k + 1];
+        for (uint32_t i = 0; i < n; i++) {
+            float x = src[i];
+            float y = c.b0*x + z1;
+            z1 = c.b1*x - c.a1*y + z2;
+            z2 = c.b2*x - c.a2*y;
+            output[i] = y;
+        }
+        state[2*k] = z1;
+        state[2*k + 1] = z2;
+        src = output; // later sections run in place
+    }
+}
+
+void BiquadCascade::reset() {
+    for (float &s : state) s = 0;
+}
+
+size_t BiquadCascade::numSections() const {
+    return coeffs.size();
+}
+
+BiquadCascadeX8::BiquadCascadeX8(uint32_t numSections)
+    : sections(numSections)
+{
+    // Default every lane to a passthrough section
+    for (Section &s : sections) {
+        for (uint32_t l = 0; l < BIQUAD_LANES; l++) {
+            s.b0[l] = 1;
+            s.b1[l] = s.b2[l] = s.a1[l] = s.a2[l] = 0;
+            s.s1[l] = s.s2[l] = 0;
+        }
+    }
+}
+
+void BiquadCascadeX8::setSection(uint32_t section, uint32_t lane, const BiquadCoeffs &coeffs) {
+    Section &s = sections[section];
+    s.b0[lane] = coeffs.b0;
+    s.b1[lane] = coeffs.b1;
+    s.b2[lane] = coeffs.b2;
+    s.a1[lane] = coeffs.a1;
+    s.a2[lane] = coeffs.a2;
+}
+
+// `input`/`output` hold n frames of BIQUAD_LANES interleaved samples
+void BiquadCascadeX8::processBlock(const float *input, float *output, uint32_t n) {
+    if (output != input)
+        for (uint32_t i = 0; i < n*BIQUAD_LANES; i++) output[i] = input[i];
+    for (Section &s : sections) processSection(s, output, n);
+}
+
+// Feeds one mono signal to every lane, e.g. a filter bank of 8 band-passes
+void BiquadCascadeX8::processBank(const float *input, float *output, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++)
+        for (uint32_t l = 0; l < BIQUAD_LANES; l++) output[i*BIQUAD_LANES + l] = input[i];
+    for (Section &s : sections) processSection(s, output, n);
+}
+
+void BiquadCascadeX8::processSection(Section &s, float *data, uint32_t n) {
+#if defined(__AVX__)
+    const __m256 b0 = _mm256_load_ps(s.b0), b1 = _mm256_load_ps(s.b1), b2 = _mm256_load_ps(s.b2);
+    const __m256 a1 = _mm256_load_ps(s.a1), a2 = _mm256_load_ps(s.a2);
+    __m256 z1 = _mm256_load_ps(s.s1), z2 = _mm256_load_ps(s.s2);
+    for (uint32_t i = 0; i < n; i++) {
+        float *p = &data[i*BIQUAD_LANES];
+        __m256 x = _mm256_loadu_ps(p);
+        __m256 y = _mm256_add_ps(_mm256_mul_ps(b0, x), z1);
+        z1 = _mm256_add_ps(_mm256_sub_ps(_mm256_mul_ps(b1, x), _mm256_mul_ps(a1, y)), z2);
+        z2 = _mm256_sub_ps(_mm256_mul_ps(b2, x), _mm256_mul_ps(a2, y));
+        _mm256_storeu_ps(p, y);
+    }
+    _mm256_store_ps(s.s1, z1);
+    _mm256_store_ps(s.s2, z2);
+#elif defined(__SSE__)
+    for (uint32_t h = 0; h < BIQUAD_LANES; h += 4) {
+        const __m128 b0 = _mm_load_ps(&s.b0[h]), b1 = _mm_load_ps(&s.b1[h]), b2 = _mm_load_ps(&s.b2[h]);
+        const __m128 a1 = _mm_load_ps(&s.a1[h]), a2 = _mm_load_ps(&s.a2[h]);
+        __m128 z1 = _mm_load_ps(&s.s1[h]), z2 = _mm_load_ps(&s.s2[h]);
+        for (uint32_t i = 0; i < n; i++) {
+            float *p = &data[i*BIQUAD_LANES + h];
+            __m128 x = _mm_loadu_ps(p);
+            __m128 y = _mm_add_ps(_mm_mul_ps(b0, x), z1);
+            z1 = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(b1, x), _mm_mul_ps(a1, y)), z2);
+            z2 = _mm_sub_ps(_mm_mul_ps(b2, x), _mm_mul_ps(a2, y));
+            _mm_storeu_ps(p, y);
+        }
+        _mm_store_ps(&s.s1[h], z1);
+        _mm_store_ps(&s.s2[h], z2);
+    }
+#else
+    for (uint32_t i = 0; i < n; i++) {
+        float *p = &data[i*BIQUAD_LANES];
+        for (uint32_t l = 0; l < BIQUAD_LANES; l++) {
+            float x = p[l];
+            float y = s.b0[l]*x + s.s1[l];
+            s.s1[l] = s.b1[l]*x - s.a1[l]*y + s.s2[l];
+            s.s2[l] = s.b2[l]*x - s.a2[l]*y;
+            p[l] = y;
+        }
+    }
+#endif
+}
+
+void BiquadCascadeX8::reset() {
+    for (Section &s : sections) {
+        for (uint32_t l = 0; l < BIQUAD_LANES; l++) s.s1[l] = s.s2[l] = 0;
+    }
+}
+
+uint32_t BiquadCascadeX8::numSections() const {
+    return sections.size();
+}
+
 #endif
@@ -0,0 +1,139 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+// Fixed-capacity blocking FIFO used between pipeline stages. Storage is
+// allocated once; waiting consumers and producers sleep on condition
+// variables instead of polling. close() wakes everyone so stages can shut
+// down.
+template <typename T>
+class BoundedQueue {
+    public:
+        BoundedQueue(uint32_t capacity);
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        bool push(const T &value);
+        bool tryPush(const T &value);
+        bool pop(T &value);
+        bool popFor(T &value, std::chrono::microseconds timeout);
+        bool tryPop(T &value);
+        void close();
+        void reopen();
+        uint32_t size();
+    private:
+        void pushLocked(const T &value);
+        T popLocked();
+
+        std::unique_ptr<T[]> data;
+        uint32_t capacity;
+        uint32_t start = 0;
+        uint32_t currSize = 0;
+        bool closed = false;
+        std::mutex mutex;
+        std::condition_variable notEmpty, notFull;
+};
+
+template <typename T>
+BoundedQueue<T>::BoundedQueue(uint32_t _capacity)
+    : data(std::make_unique<T[]>(_capacity)),
+      capacity(_capacity)
+{ }
+
+template <typename T>
+void BoundedQueue<T>::pushLocked(const T &value) {
+    data[(start + currSize) % capacity] = value;
+    currSize++;
+}
+
+template <typename T>
+T BoundedQueue<T>::popLocked() {
+    T value = data[start];
+    start = (start + 1) % capacity;
+    currSize--;
+    return value;
+}
+
+// Blocks while full. Returns false once the queue is closed.
+template <typename T>
+bool BoundedQueue<T>::push(const T &value) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notFull.wait(lock, [this]() { return closed || currSize < capacity; });
+    if (closed) return false;
+    pushLocked(value);
+    lock.unlock();
+    notEmpty.notify_one();
+    return true;
+}
+
+template <typename T>
+bool BoundedQueue<T>::tryPush(const T &value) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (closed || currSize == capacity) return false;
+    pushLocked(value);
+    lock.unlock();
+    notEmpty.notify_one();
+    return true;
+}
+
+// Blocks while empty. Returns false once the queue is closed and drained.
+template <typename T>
+bool BoundedQueue<T>::pop(T &value) {
+    std::unique_lock<std::mutex> lock(mutex);
+    notEmpty.wait(lock, [this]() { return closed || currSize > 0; });
+    if (currSize == 0) return false;
+    value = popLocked();
+    lock.unlock();
+    notFull.notify_one();
+    return true;
+}
+
+template <typename T>
+bool BoundedQueue<T>::popFor(T &value, std::chrono::microseconds timeout) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!notEmpty.wait_for(lock, timeout, [this]() { return closed || currSize > 0; })) return false;
+    if (currSize == 0) return false;
+    value = popLocked();
+    lock.unlock();
+    notFull.notify_one();
+    return true;
+}
+
+template <typename T>
+bool BoundedQueue<T>::tryPop(T &value) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (currSize == 0) return false;
+    value = popLocked();
+    lock.unlock();
+    notFull.notify_one();
+    return true;
+}
+
+template <typename T>
+void BoundedQueue<T>::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+    }
+    notEmpty.notify_all();
+    notFull.notify_all();
+}
+
+template <typename T>
+void BoundedQueue<T>::reopen() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = false;
+}
+
+template <typename T>
+uint32_t BoundedQueue<T>::size() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return currSize;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef CAPTURE_GROUP_H
+#define CAPTURE_GROUP_H
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "Recorder.hpp"
+
+// Several input streams, possibly on different devices, started and stopped
+// together. Each recorder stamps its buffers on steady_clock, so the frame
+// offset between any two streams can be read off at a common instant and
+// used to line their channels up for array processing.
+class CaptureGroup {
+    public:
+        CaptureGroup(uint32_t _fftSize);
+        CaptureGroup(const CaptureGroup&) = delete;
+        CaptureGroup& operator=(const CaptureGroup&) = delete;
+        ~CaptureGroup();
+
+        Recorder& add(PaDeviceIndex device, uint32_t numChannels);
+        bool start();
+        void stop();
+
+        uint32_t size() const;
+        uint32_t totalChannels() const;
+        Recorder& operator[](uint32_t i);
+        int64_t offsetFrames(uint32_t i) const;
+    private:
+        uint32_t fftSize;
+        std::vector<std::unique_ptr<Recorder>> recorders;
+};
+
+CaptureGroup::CaptureGroup(uint32_t _fftSize)
+    : fftSize(_fftSize)
+{ }
+
+CaptureGroup::~CaptureGroup() {
+    stop();
+}
+
+Recorder& CaptureGroup::add(PaDeviceIndex device, uint32_t numChannels) {
+    recorders.push_back(std::make_unique<Recorder>(fftSize, numChannels, device));
+    return *recorders.back();
+}
+
+// All or nothing: if any stream fails to start the others are stopped again
+bool CaptureGroup::start() {
+    for (size_t i = 0; i < recorders.size(); i++) {
+        if (!recorders[i]->start()) {
+            std::cout << "Failed to start capture stream " << i << std::endl;
+            for (size_t j = 0; j < i; j++) recorders[j]->stop();
+            return false;
+        }
+    }
+    return true;
+}
+
+void CaptureGroup::stop() {
+    for (std::unique_ptr<Recorder> &recorder : recorders) recorder->stop();
+}
+
+uint32_t CaptureGroup::size() const {
+    return recorders.size();
+}
+
+uint32_t CaptureGroup::totalChannels() const {
+    uint32_t total = 0;
+    for (const std::unique_ptr<Recorder> &recorder : recorders) total += recorder->getNumChannels();
+    return total;
+}
+
+Recorder& CaptureGroup::operator[](uint32_t i) {
+    return *recorders[i];
+}
+
+// How many frames stream i is ahead of stream 0 at the same instant. Skip
+// that many frames of stream i (or stream 0 if negative) to align them.
+int64_t CaptureGroup::offsetFrames(uint32_t i) const {
+    TimePoint now = std::chrono::steady_clock::now();
+    return recorders[i]->frameAt(now) - recorders[0]->frameAt(now);
+}
+
+#endif
@@ -0,0 +1,294 @@
+#ifndef CAPTURE_WRITER_H
+#define CAPTURE_WRITER_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "BoundedQueue.hpp"
+#include "Recorder.hpp"
+#include "SampleFile.hpp"
+
+#define WRITER_BLOCK_BYTES  (1 << 20)   // per buffer, two are in flight
+#define WRITER_ALIGN        4096        // page aligned so the kernel copies whole pages
+#define WRITER_TAP_FRAMES   (1 << 17)   // Recorder tap size, covers a few seconds of disk stall
+#define WRITER_WAIT_MS      50
+#define WRITER_FLUSH_MS     500         // longest a partly filled block waits before being written
+
+// Streams everything the Recorder captures to disk. A collector thread
+// drains the Recorder's tap into one of two large aligned blocks while a
+// disk thread writes the other, so a slow disk only ever backs up into the
+// tap, which the audio callback drops into instead of waiting on.
+// Samples are written in the Recorder's SampleFormat. Files ending in .wav
+// get a float or 16-bit PCM WAV header to match (patched with the final size
+// on close), anything else is written headerless like recorded.raw. With
+// a size or time limit the output rotates to base-0001.wav, base-0002.wav...
+class CaptureWriter {
+    public:
+        CaptureWriter(Recorder &_recorder, const std::string &_path, uint64_t _rotateBytes = 0, uint32_t _rotateSeconds = 0);
+        CaptureWriter(const CaptureWriter&) = delete;
+        CaptureWriter& operator=(const CaptureWriter&) = delete;
+        ~CaptureWriter();
+
+        bool start();
+        void stop();
+        bool isRunning() const;
+        bool hasFailed() const;
+
+        uint64_t getFramesWritten() const;
+        uint32_t getFilesWritten() const;
+        uint64_t getDropped() const;
+    private:
+        struct WriteBlock {
+            char *data = nullptr;
+            uint32_t bytes = 0;
+        };
+
+        void collectLoop();
+        void diskLoop();
+        bool openNext();
+        void closeFile();
+        std::string fileName(uint32_t index) const;
+
+        Recorder &recorder;
+        std::string path;
+        bool wav;
+        uint64_t rotateBytes;
+        uint32_t rotateSeconds;
+        uint32_t frameBytes = 0;
+        uint32_t sampleRate = 0;
+        uint64_t framesPerFile = 0;     // 0 = no rotation
+
+        WriteBlock blocks[2];
+        BoundedQueue<WriteBlock*> freeBlocks;
+        BoundedQueue<WriteBlock*> fullBlocks;
+        std::thread collectThread;
+        std::thread diskThread;
+        std::atomic<bool> running{false};
+
+        // Disk thread only
+        int fd = -1;
+        uint64_t fileFrames = 0;
+
+        std::atomic<uint64_t> framesWritten{0};
+        std::atomic<uint32_t> filesWritten{0};
+        std::atomic<bool> failed{false};
+};
+
+CaptureWriter::CaptureWriter(Recorder &_recorder, const std::string &_path, uint64_t _rotateBytes, uint32_t _rotateSeconds)
+    : recorder(_recorder),
+      path(_path),
+      rotateBytes(_rotateBytes),
+      rotateSeconds(_rotateSeconds),
+      freeBlocks(2),
+      fullBlocks(2)
+{
+    wav = path.size() >= 4 && strcasecmp(path.c_str() + path.size() - 4, ".wav") == 0;
+    for (WriteBlock &block : blocks) {
+        block.data = (char*) std::aligned_alloc(WRITER_ALIGN, WRITER_BLOCK_BYTES);
+    }
+    // The same tap memory holds twice the frames at int16
+    uint32_t tapFrames = WRITER_TAP_FRAMES * sizeof(float) / sampleBytes(recorder.getFormat());
+    if (!recorder.enableTap(tapFrames)) {
+        std::cout << "Failed to enable the capture tap, the recorder is already running" << std::endl;
+    }
+}
+
+CaptureWriter::~CaptureWriter() {
+    stop();
+    for (WriteBlock &block : blocks) std::free(block.data);
+}
+
+// Call after the Recorder has started, once its sample rate is known
+bool CaptureWriter::start() {
+    if (running) return true;
+    sampleRate = recorder.getSampleRate();
+    frameBytes = sampleBytes(recorder.getFormat()) * recorder.getNumChannels();
+    if (sampleRate == 0 || blocks[0].data == nullptr || blocks[1].data == nullptr) {
+        std::cout << "Failed to start capture writer" << std::endl;
+        return false;
+    }
+
+    framesPerFile = rotateBytes / frameBytes;
+    uint64_t timeFrames = (uint64_t) rotateSeconds * sampleRate;
+    if (timeFrames > 0 && (framesPerFile == 0 || timeFrames < framesPerFile)) framesPerFile = timeFrames;
+    if (wav) {
+        // RIFF sizes are 32 bit
+        uint64_t wavFrames = (UINT32_MAX - WAV_HEADER_BYTES) / frameBytes;
+        if (framesPerFile == 0 || framesPerFile > wavFrames) framesPerFile = wavFrames;
+    }
+
+    WriteBlock *block;
+    while (freeBlocks.tryPop(block)) { }
+    while (fullBlocks.tryPop(block)) { }
+    freeBlocks.reopen();
+    fullBlocks.reopen();
+    for (WriteBlock &b : blocks) {
+        b.bytes = 0;
+        freeBlocks.push(&b);
+    }
+
+    failed = false;
+    running = true;
+    diskThread = std::thread(&CaptureWriter::diskLoop, this);
+    collectThread = std::thread(&CaptureWriter::collectLoop, this);
+    return true;
+}
+
+// Writes out whatever is still in the tap before returning
+void CaptureWriter::stop() {
+    if (!running) return;
+    running = false;
+    if (collectThread.joinable()) collectThread.join();
+    if (diskThread.joinable()) diskThread.join();
+}
+
+// False once a disk error has ended the recording, though stop() still
+// has to be called
+bool CaptureWriter::isRunning() const {
+    return running && !failed;
+}
+
+bool CaptureWriter::hasFailed() const {
+    return failed;
+}
+
+void CaptureWriter::collectLoop() {
+    uint32_t blockFrames = WRITER_BLOCK_BYTES / frameBytes;
+    WriteBlock *block = nullptr;
+    freeBlocks.pop(block);
+    TimePoint filled = std::chrono::steady_clock::now();
+    uint32_t lastSeen = recorder.dataNotifier().current();
+
+    while (true) {
+        bool stopping = !running;
+        uint32_t frames = block->bytes / frameBytes;
+        int n = recorder.readTap(block->data + block->bytes, blockFrames - frames);
+        block->bytes += n * frameBytes;
+
+        // A block's age counts from its first frame
+        TimePoint now = std::chrono::steady_clock::now();
+        if (frames == 0) filled = now;
+        bool full = block->bytes / frameBytes == blockFrames;
+        bool stale = block->bytes > 0 && now - filled >= std::chrono::milliseconds(WRITER_FLUSH_MS);
+        if (full || stale || (stopping && n == 0 && block->bytes > 0)) {
+            fullBlocks.push(block);
+            freeBlocks.pop(block);
+            continue;
+        }
+        if (stopping && n == 0) break;
+        if (n == 0) lastSeen = recorder.dataNotifier().wait(lastSeen, WRITER_WAIT_MS);
+    }
+    fullBlocks.close();
+}
+
+void CaptureWriter::diskLoop() {
+    WriteBlock *block;
+    while (fullBlocks.pop(block)) {
+        const char *src = block->data;
+        uint64_t frames = block->bytes / frameBytes;
+        while (frames > 0 && !failed) {
+            if ((fd < 0 || (framesPerFile > 0 && fileFrames >= framesPerFile)) && !openNext()) {
+                failed = true;
+                break;
+            }
+            uint64_t take = frames;
+            if (framesPerFile > 0 && take > framesPerFile - fileFrames) take = framesPerFile - fileFrames;
+
+            size_t bytes = take * frameBytes, done = 0;
+            while (done < bytes) {
+                ssize_t written = ::write(fd, src + done, bytes - done);
+                if (written < 0 && errno == EINTR) continue;
+                if (written < 0) {
+                    std::cout << "Failed to write capture: " << strerror(errno) << std::endl;
+                    failed = true;
+                    break;
+                }
+                done += written;
+            }
+            // Only whole frames that reached the file count
+            uint64_t doneFrames = done / frameBytes;
+            src += done;
+            fileFrames += doneFrames;
+            framesWritten.fetch_add(doneFrames, std::memory_order_relaxed);
+            frames -= take;
+        }
+        block->bytes = 0;
+        freeBlocks.push(block);
+    }
+    closeFile();
+}
+
+bool CaptureWriter::openNext() {
+    closeFile();
+    std::string name = fileName(filesWritten + 1);
+    fd = ::open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cout << "Failed to open " << name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    fileFrames = 0;
+    filesWritten++;
+
+    if (wav) {
+        // Sizes are patched in closeFile()
+        uint8_t header[WAV_HEADER_BYTES];
+        makeWavHeader(header, recorder.getNumChannels(), sampleRate, 0, recorder.getFormat());
+        if (::write(fd, header, WAV_HEADER_BYTES) != WAV_HEADER_BYTES) {
+            std::cout << "Failed to write WAV header to " << name << std::endl;
+            ::close(fd);
+            fd = -1;
+            return false;
+        }
+    }
+    return true;
+}
+
+void CaptureWriter::closeFile() {
+    if (fd < 0) return;
+    if (wav) {
+        uint32_t dataSize = fileFrames * frameBytes;
+        uint32_t riffSize = dataSize + WAV_HEADER_BYTES - 8;
+        if (pwrite(fd, &riffSize, 4, 4) != 4 || pwrite(fd, &dataSize, 4, 40) != 4) {
+            std::cout << "Failed to finish WAV header" << std::endl;
+        }
+    }
+    ::close(fd);
+    fd = -1;
+}
+
+// `path` itself for the first file without rotation, otherwise an index
+// before the extension (a WAV still rotates when it reaches 4 GB)
+std::string CaptureWriter::fileName(uint32_t index) const {
+    if (index == 1 && rotateBytes == 0 && rotateSeconds == 0) return path;
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = path.size();
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "-%04u", index);
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+uint64_t CaptureWriter::getFramesWritten() const {
+    return framesWritten.load(std::memory_order_relaxed);
+}
+
+uint32_t CaptureWriter::getFilesWritten() const {
+    return filesWritten;
+}
+
+// Frames the Recorder's tap had to drop because the writer fell behind
+uint64_t CaptureWriter::getDropped() const {
+    return recorder.getTapDropped();
+}
+
+#endif
@@ -6,19 +6,38 @@
 #include <iostream>
 #include <iomanip>
 #include <memory>
+#include <type_traits>
 
+#include "Span.hpp"
+
+// Ring buffer that overwrites the oldest data when full. Block operations
+// copy at most two contiguous runs, and peek/peekLatest hand out views
+// straight into the storage so a window can be fed to the FFT without an
+// intermediate copy. Storage is owned, or borrowed from the caller (e.g. a
+// FrameArena) for the buffer's whole lifetime.
 template <typename T>
 class CircularBuffer {
+    static_assert(std::is_trivially_copyable<T>::value, "CircularBuffer requires trivially copyable T");
     public:
         CircularBuffer(uint32_t capacity);
+        CircularBuffer(Span<T> storage);
         void write(T value);
         T read();
-        void writeBlock(std::unique_ptr<T[]> block, uint32_t size);
-        void readBlock(T *fftIn, uint32_t N);
+        uint32_t write(Span<const T> block);
+        uint32_t readBlock(T *outputBuffer, uint32_t n);
+        uint32_t readLatest(T *outputBuffer, uint32_t n);
+        SpanPair<const T> peek(uint32_t n) const;
+        SpanPair<const T> peekLatest(uint32_t n) const;
+        uint32_t consume(uint32_t n);
+        void clear();
         uint32_t getCurrSize();
+        uint32_t getCapacity() const;
         void print();
     private:
-        std::unique_ptr<T[]> data;
+        uint32_t wrap(uint32_t index) const;
+
+        std::unique_ptr<T[]> owned;
+        T *data;
         uint32_t capacity;
         uint32_t start; // read index
         uint32_t end;   // write index
@@ -28,7 +47,15 @@ class CircularBuffer {
 template <typename T>
 CircularBuffer<T>::CircularBuffer(uint32_t bufCapacity) {
     capacity = bufCapacity;
-    data = std::make_unique<T[]>(capacity);
+    owned = std::make_unique<T[]>(capacity);
+    data = owned.get();
+    start = end = currSize = 0;
+}
+
+template <typename T>
+CircularBuffer<T>::CircularBuffer(Span<T> storage) {
+    capacity = storage.size();
+    data = storage.data();
     start = end = currSize = 0;
 }
 
@@ -55,30 +82,86 @@ T CircularBuffer<T>::read() {
 }
 
 template <typename T>
-void CircularBuffer<T>::writeBlock(std::unique_ptr<T[]> block, uint32_t size) {
-    for (uint32_t i = 0; i < size; i++) {
-        data[end] = block[i];
-        end = (end + 1) % capacity;
+uint32_t CircularBuffer<T>::wrap(uint32_t index) const {
+    return index >= capacity ? index - capacity : index;
+}
+
+// Appends a block, overwriting the oldest elements if it does not fit.
+// Returns how many buffered or incoming elements were lost.
+template <typename T>
+uint32_t CircularBuffer<T>::write(Span<const T> block) {
+    uint32_t n = (uint32_t) block.size();
+    const T *src = block.data();
+    uint32_t lost = 0;
+    if (n > capacity) { // only the newest `capacity` elements can survive
+        lost = n - capacity;
+        src += lost;
+        n = capacity;
     }
 
-    // Change currSize once
-    if (currSize + size < capacity) {
-        currSize += size;
+    uint32_t first = n <= capacity - end ? n : capacity - end;
+    if (first > 0) std::memcpy(&data[end], src, sizeof(T) * first);
+    if (n > first) std::memcpy(&data[0], &src[first], sizeof(T) * (n - first));
+    end = wrap(end + n);
+
+    if (currSize + n <= capacity) {
+        currSize += n;
     } else {
+        lost += currSize + n - capacity;
         currSize = capacity;
-        start = end;    // update start when overflows
+        start = end;    // full, so the oldest element sits at the write index
     }
+    return lost;
 }
 
+// The oldest min(n, size) elements, without consuming them
 template <typename T>
-void CircularBuffer<T>::readBlock(T *outputBuffer, uint32_t N) {
-    uint32_t first = N <= (capacity - start) ? N : capacity - start; // num elements to read from start
-    uint32_t second = N - first; // num elements to read from 0
+SpanPair<const T> CircularBuffer<T>::peek(uint32_t n) const {
+    uint32_t count = n <= currSize ? n : currSize;
+    uint32_t first = count <= capacity - start ? count : capacity - start;
+    return {Span<const T>(&data[start], first), Span<const T>(&data[0], count - first)};
+}
 
-    std::memcpy(outputBuffer, &data[start], sizeof(T) * first);
+// The newest n elements, or nothing if fewer than n are buffered
+template <typename T>
+SpanPair<const T> CircularBuffer<T>::peekLatest(uint32_t n) const {
+    if (n == 0 || n > currSize) return {};
+    uint32_t from = end >= n ? end - n : end + capacity - n;
+    uint32_t first = n <= capacity - from ? n : capacity - from;
+    return {Span<const T>(&data[from], first), Span<const T>(&data[0], n - first)};
+}
 
-    if (second > 0)
-        std::memcpy(&outputBuffer[first], &data[0], sizeof(T) * second);
+template <typename T>
+uint32_t CircularBuffer<T>::consume(uint32_t n) {
+    uint32_t count = n <= currSize ? n : currSize;
+    start = wrap(start + count);
+    currSize -= count;
+    return count;
+}
+
+// Copies and consumes up to n of the oldest elements, returning how many
+template <typename T>
+uint32_t CircularBuffer<T>::readBlock(T *outputBuffer, uint32_t n) {
+    SpanPair<const T> region = peek(n);
+    region.copyTo(outputBuffer);
+    return consume((uint32_t) region.size());
+}
+
+// Copies the newest n elements and discards everything buffered, so a
+// display never lags behind. Returns 0 and leaves the buffer alone if
+// fewer than n are available.
+template <typename T>
+uint32_t CircularBuffer<T>::readLatest(T *outputBuffer, uint32_t n) {
+    SpanPair<const T> region = peekLatest(n);
+    if (region.empty()) return 0;
+    region.copyTo(outputBuffer);
+    clear();
+    return n;
+}
+
+template <typename T>
+void CircularBuffer<T>::clear() {
+    start = end = currSize = 0;
 }
 
 template <typename T>
@@ -86,6 +169,11 @@ uint32_t CircularBuffer<T>::getCurrSize() {
     return currSize;
 }
 
+template <typename T>
+uint32_t CircularBuffer<T>::getCapacity() const {
+    return capacity;
+}
+
 template <typename T>
 void CircularBuffer<T>::print() {
     std::cout << '|';
@@ -0,0 +1,305 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <strings.h>
+
+#include "ConstantQ.hpp"
+#include "FrequencyAxis.hpp"
+#include "Recorder.hpp"
+#include "SampleSource.hpp"
+#include "SpectrumAverager.hpp"
+#include "STFT.hpp"
+
+// Defaults, overridden by the config file and then the command line
+#define FFT_SIZE    1024
+#define MAX_FFT_SIZE    (1 << 20)   // larger sizes are rejected rather than allocated
+#define FFT_WINDOW  WindowType::Hann
+#define DSP_WORKERS 2
+#define CAPTURE_RATE    0           // 0 = device default, decimated to SAMPLE_RATE for analysis
+#define WIN_WIDTH   1280
+#define WIN_HEIGHT  800
+#define DB_MIN      -80
+#define DB_MAX      0
+#define CAPTURE_FILE    "recorded.raw"
+#define CONFIG_FILE     "iir-test.conf"
+
+// Runtime settings for the live app. Every field has a key usable both as
+// `key = value` in a config file and as `--key value` on the command line;
+// '#' starts a comment in the file.
+struct Config {
+    uint32_t fftSize = FFT_SIZE;
+    uint32_t hopSize = 0;                       // 0 = fftSize/4, 75% overlap
+    WindowType window = FFT_WINDOW;
+    bool logAxis = false;                       // log-frequency display axis
+    uint32_t cqBins = 0;                        // constant-Q bins per octave, 0 = plain FFT
+    float cqMin = CQ_MIN_FREQ;                  // lowest constant-Q bin, Hz
+    uint32_t sampleRate = SAMPLE_RATE;          // analysis rate
+    uint32_t captureRate = CAPTURE_RATE;
+    uint32_t framesPerBuffer = FRAMES_PER_BUFFER;
+    uint32_t numChannels = NUM_CHANNELS;
+    SampleFormat sampleFormat = SampleFormat::Float32;  // capture, ring and recording format
+    uint32_t channel = 0;                       // channel shown live
+    std::string device;                         // index or part of the name, empty for default
+    SourceSpec source;                          // PortAudio unless a file, generator or null source is chosen
+    float speed = 1;                            // times real time for non-device sources, 0 = as fast as consumed
+    uint32_t dspWorkers = DSP_WORKERS;
+    bool hugePages = false;                     // back analysis buffers with huge pages when available
+    AverageSpec average;                        // aggregation of successive spectra, none by default
+    uint32_t width = WIN_WIDTH;
+    uint32_t height = WIN_HEIGHT;
+    float dBMin = DB_MIN;
+    float dBMax = DB_MAX;
+    std::string captureFile = CAPTURE_FILE;
+    std::string record;                         // live capture written here when set, .wav or raw
+    uint32_t rotateMB = 0;                      // 0 = no size limit per file
+    uint32_t rotateSeconds = 0;                 // 0 = no time limit per file
+    std::vector<float> trackFreqs;              // tones followed sample by sample, Hz
+
+    bool set(const std::string &key, const std::string &value);
+    static bool parseUInt(const char *str, uint32_t &value);
+    static bool parseFloat(const char *str, float &value);
+    static bool parseFlag(const char *str, bool &value);
+    static bool parseList(const char *str, std::vector<float> &values);
+    bool loadFile(const char *filename);
+    bool parseArgs(int argc, char **argv);
+    bool validate() const;
+    float fundFreq() const;
+    PaDeviceIndex inputDevice() const;
+
+    static void usage(const char *prog);
+};
+
+bool Config::set(const std::string &key, const std::string &value) {
+    const char *v = value.c_str();
+    if (key == "fft-size") return parseUInt(v, fftSize);
+    else if (key == "hop-size") return parseUInt(v, hopSize);
+    else if (key == "window") return parseWindow(v, window);
+    else if (key == "freq-axis") return parseFrequencyAxis(v, logAxis);
+    else if (key == "cq") return parseUInt(v, cqBins);
+    else if (key == "cq-min") return parseFloat(v, cqMin);
+    else if (key == "sample-rate") return parseUInt(v, sampleRate);
+    else if (key == "capture-rate") return parseUInt(v, captureRate);
+    else if (key == "frames-per-buffer") return parseUInt(v, framesPerBuffer);
+    else if (key == "channels") return parseUInt(v, numChannels);
+    else if (key == "sample-format") return parseSampleFormat(v, sampleFormat);
+    else if (key == "channel") return parseUInt(v, channel);
+    else if (key == "device") device = value;
+    else if (key == "source") return parseSource(v, source);
+    else if (key == "speed") return parseFloat(v, speed);
+    else if (key == "workers") return parseUInt(v, dspWorkers);
+    else if (key == "huge-pages") return parseFlag(v, hugePages);
+    else if (key == "average") return parseAverage(v, average);
+    else if (key == "width") return parseUInt(v, width);
+    else if (key == "height") return parseUInt(v, height);
+    else if (key == "db-min") return parseFloat(v, dBMin);
+    else if (key == "db-max") return parseFloat(v, dBMax);
+    else if (key == "input") captureFile = value;
+    else if (key == "record") record = value;
+    else if (key == "rotate-mb") return parseUInt(v, rotateMB);
+    else if (key == "rotate-seconds") return parseUInt(v, rotateSeconds);
+    else if (key == "track") return parseList(v, trackFreqs);
+    else return false;
+    return true;
+}
+
+// Whole decimal numbers that fit in 32 bits; signs, trailing text and
+// empty values are rejected rather than wrapped or read as 0
+bool Config::parseUInt(const char *str, uint32_t &value) {
+    if (*str < '0' || *str > '9') return false;
+    char *end;
+    errno = 0;
+    long long parsed = strtoll(str, &end, 10);
+    if (errno != 0 || *end != '\0' || parsed > UINT32_MAX) return false;
+    value = (uint32_t) parsed;
+    return true;
+}
+
+bool Config::parseFloat(const char *str, float &value) {
+    char *end;
+    errno = 0;
+    float parsed = strtof(str, &end);
+    if (end == str || errno != 0 || *end != '\0' || !std::isfinite(parsed)) return false;
+    value = parsed;
+    return true;
+}
+
+// 0 or 1
+bool Config::parseFlag(const char *str, bool &value) {
+    uint32_t parsed;
+    if (!parseUInt(str, parsed) || parsed > 1) return false;
+    value = parsed != 0;
+    return true;
+}
+
+// Comma separated numbers, e.g. "697,770,852,941"
+bool Config::parseList(const char *str, std::vector<float> &values) {
+    values.clear();
+    while (*str != '\0') {
+        char *end;
+        float value = strtof(str, &end);
+        if (end == str) return false;
+        values.push_back(value);
+        while (*end == ' ' || *end == ',') end++;
+        str = end;
+    }
+    return true;
+}
+
+// Missing files are not an error, so a default config path can always be tried
+bool Config::loadFile(const char *filename) {
+    std::ifstream file(filename);
+    if (!file) return true;
+
+    std::string line;
+    uint32_t lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+            std::cout << filename << ":" << lineNumber << ": expected key = value" << std::endl;
+            return false;
+        }
+
+        auto trim = [](std::string str) {
+            size_t first = str.find_first_not_of(" \t\r");
+            size_t last = str.find_last_not_of(" \t\r");
+            return first == std::string::npos ? std::string() : str.substr(first, last - first + 1);
+        };
+        std::string key = trim(line.substr(0, eq)), value = trim(line.substr(eq + 1));
+        if (!set(key, value)) {
+            std::cout << filename << ":" << lineNumber << ": bad setting \'" << key << "\'" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Reads --config (default CONFIG_FILE) first so the command line wins.
+// A bare argument is taken as the capture file.
+bool Config::parseArgs(int argc, char **argv) {
+    const char *configFile = CONFIG_FILE;
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--config") == 0) configFile = argv[i + 1];
+    }
+    if (!loadFile(configFile)) return false;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0) return false;
+        if (strncmp(argv[i], "--", 2) != 0) {
+            captureFile = argv[i];
+            continue;
+        }
+        if (i + 1 >= argc) {
+            std::cout << "Missing value for " << argv[i] << std::endl;
+            return false;
+        }
+        std::string key = argv[i] + 2;
+        std::string value = argv[++i];
+        if (key == "config") continue;
+        if (!set(key, value)) {
+            std::cout << "Unknown option --" << key << " or bad value \'" << value << "\'" << std::endl;
+            return false;
+        }
+    }
+    if (hopSize == 0) hopSize = fftSize/4;
+    return validate();
+}
+
+bool Config::validate() const {
+    if (fftSize < 16 || fftSize > MAX_FFT_SIZE || hopSize == 0 || hopSize > fftSize) {
+        std::cout << "Need 16 <= fft-size <= " << MAX_FFT_SIZE << " and 0 < hop-size <= fft-size" << std::endl;
+        return false;
+    }
+    if (sampleRate == 0 || framesPerBuffer == 0 || numChannels == 0 || channel >= numChannels) {
+        std::cout << "Need nonzero sample-rate, frames-per-buffer and channels, and channel < channels" << std::endl;
+        return false;
+    }
+    if (cqBins > 0 && (cqMin <= 0 || cqMin >= sampleRate/4.0f
+                       || ConstantQ::fftSizeFor(sampleRate, cqMin, cqBins) >= CQ_MAX_FFT_SIZE)) {
+        std::cout << "Need 0 < cq-min < sample-rate/4, and high enough for a constant-Q FFT below "
+                  << CQ_MAX_FFT_SIZE << std::endl;
+        return false;
+    }
+    // Raw files carry no format and are read back as float
+    if (sampleFormat == SampleFormat::Int16 && !record.empty() &&
+        (record.size() < 4 || strcasecmp(record.c_str() + record.size() - 4, ".wav") != 0)) {
+        std::cout << "Need a .wav record file with sample-format int16" << std::endl;
+        return false;
+    }
+    if (speed < 0) {
+        std::cout << "Need speed >= 0" << std::endl;
+        return false;
+    }
+    for (float freq : trackFreqs) {
+        if (freq < 0 || freq > sampleRate/2.0f) {
+            std::cout << "Tracked frequencies must be between 0 and " << sampleRate/2 << " Hz" << std::endl;
+            return false;
+        }
+    }
+    if (width == 0 || height == 0 || dBMin >= dBMax) {
+        std::cout << "Need a nonzero window size and db-min < db-max" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+float Config::fundFreq() const {
+    return (float) sampleRate/fftSize;
+}
+
+// `device` as an index, or the first input whose name contains it
+PaDeviceIndex Config::inputDevice() const {
+    if (device.empty()) return paNoDevice;
+    if (device.find_first_not_of("0123456789") == std::string::npos) return atoi(device.c_str());
+    PaDeviceIndex index = Recorder::findDevice(device.c_str());
+    if (index == paNoDevice) std::cout << "Failed to find input device \'" << device << "\', using the default" << std::endl;
+    return index;
+}
+
+void Config::usage(const char *prog) {
+    std::cout << "Usage: " << prog << " [--key value ...] [capture.raw|capture.wav]" << std::endl
+              << "Keys may also be set as `key = value` in " << CONFIG_FILE << " or --config <file>" << std::endl
+              << "  --fft-size <n>           FFT size (default " << FFT_SIZE << ")" << std::endl
+              << "  --hop-size <n>           hop size (default fft/4)" << std::endl
+              << "  --window <name>          hann, blackman, kaiser or rect (default hann)" << std::endl
+              << "  --freq-axis <scale>      linear or log frequency axis (default linear)" << std::endl
+              << "  --cq <n>                 constant-Q analysis with n bins per octave, on a log axis (default off)" << std::endl
+              << "  --cq-min <hz>            lowest constant-Q bin, sets the FFT size (default " << CQ_MIN_FREQ << ")" << std::endl
+              << "  --sample-rate <hz>       analysis rate (default " << SAMPLE_RATE << ")" << std::endl
+              << "  --capture-rate <hz>      device rate, 0 for its default (default " << CAPTURE_RATE << ")" << std::endl
+              << "  --frames-per-buffer <n>  audio callback size (default " << FRAMES_PER_BUFFER << ")" << std::endl
+              << "  --channels <n>           input channels (default " << NUM_CHANNELS << ")" << std::endl
+              << "  --sample-format <fmt>    float or int16 capture and rings (default float)" << std::endl
+              << "  --channel <n>            channel shown (default 0)" << std::endl
+              << "  --device <index|name>    input device (default system default)" << std::endl
+              << "  --source <source>        portaudio (default), file:<path>, tone:<hz>, noise," << std::endl
+              << "                           chirp:<hz>:<hz>[:<seconds>] or null" << std::endl
+              << "  --speed <x>              pace of non-device sources, 0 for as fast as processed (default 1)" << std::endl
+              << "  --workers <n>            DSP threads (default " << DSP_WORKERS << ")" << std::endl
+              << "  --huge-pages <0|1>       huge page backing for frame memory (default 0)" << std::endl
+              << "  --average <mode>         none (default), exp[:<frames>], linear[:<frames>]," << std::endl
+              << "                           peak[:<dB per frame>], p50 or p95" << std::endl
+              << "  --width <px>, --height <px>" << std::endl
+              << "  --db-min <dB>, --db-max <dB>" << std::endl
+              << "  --input <file>           capture to step through (default " << CAPTURE_FILE << ")" << std::endl
+              << "  --record <file>          write the live capture to a .wav or raw file" << std::endl
+              << "                           raw files have no header; read them back with the same" << std::endl
+              << "                           --sample-rate and --channels, or iir-filter -r and -c" << std::endl
+              << "  --rotate-mb <n>, --rotate-seconds <n>" << std::endl
+              << "                           start a new numbered file at this size or length" << std::endl
+              << "  --track <hz,hz,...>      follow these tones every sample with a sliding DFT" << std::endl;
+}
+
+#endif
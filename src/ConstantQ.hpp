@@ -0,0 +1,225 @@
+#ifndef CONSTANT_Q_H
+#define CONSTANT_Q_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <fftw3.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "DBKernel.hpp"
+#include "FrequencyAxis.hpp"
+#include "PlanRegistry.hpp"
+
+#define CQ_MIN_FREQ         55          // A1, keeps the longest kernel within an 8192 FFT at 16 kHz
+#define CQ_BINS_PER_OCTAVE  12
+#define CQ_KERNEL_THRESHOLD 0.0054f     // kernel spectrum below this fraction of its peak is dropped
+#define CQ_MAX_FFT_SIZE     (1 << 17)
+
+// Constant-Q (log-frequency) spectrum computed from one large FFT, after
+// Brown and Puckette. Bin k is centred on fMin*2^(k/binsPerOctave) and
+// analyzed with a Hann window Q cycles long, so every bin has the same
+// relative bandwidth: long windows at the bottom, short ones at the top.
+// Each bin's temporal kernel is transformed once up front; its spectrum is
+// a narrow band around the bin frequency, kept as a contiguous run of FFT
+// bins. Per frame that leaves one real FFT of getFFTSize() over the
+// unwindowed samples plus a short complex dot product per bin. Kernels are
+// centred in the frame, so all bins describe the same instant.
+class ConstantQ {
+    public:
+        ConstantQ(PlanRegistry &plans, uint32_t _sampleRate, float fMin, uint32_t _binsPerOctave = CQ_BINS_PER_OCTAVE);
+        ConstantQ(const ConstantQ&) = delete;
+        ConstantQ& operator=(const ConstantQ&) = delete;
+        ~ConstantQ();
+
+        void apply(const fftwf_complex *spectrum, float *dB) const;
+        void analyze(const float *samples, float *dB);
+
+        uint32_t getFFTSize() const;
+        uint32_t getNumBins() const;
+        float getFrequency(uint32_t bin) const;
+        uint32_t getKernelTaps() const;
+        FrequencyAxis axis() const;
+
+        static uint32_t fftSizeFor(uint32_t sampleRate, float fMin, uint32_t binsPerOctave);
+    private:
+        float dot(const float *x, const float *k, uint32_t n, float &im) const;
+
+        uint32_t sampleRate, binsPerOctave, fftSize;
+        float q;
+        std::vector<float> freqs;
+        std::vector<uint32_t> first;    // first FFT bin of each kernel
+        std::vector<uint32_t> offset;   // start of each kernel in `kernel`, plus an end marker
+        std::vector<float> kernel;      // interleaved complex, conj(T[j])/fftSize
+        fftwf_plan plan;
+        float *scratchIn;               // analyze() only
+        fftwf_complex *scratchOut;
+};
+
+ConstantQ::ConstantQ(PlanRegistry &plans, uint32_t _sampleRate, float fMin, uint32_t _binsPerOctave)
+    : sampleRate(_sampleRate),
+      binsPerOctave(_binsPerOctave == 0 ? CQ_BINS_PER_OCTAVE : _binsPerOctave),
+      fftSize(fftSizeFor(_sampleRate, fMin, binsPerOctave)),
+      q(1/(std::pow(2.0f, 1.0f/binsPerOctave) - 1))
+{
+    // Stop where a bin's band would reach Nyquist
+    for (uint32_t k = 0; ; k++) {
+        float f = fMin*std::pow(2.0f, (float) k/binsPerOctave);
+        if (f*(1 + 1/(2*q)) >= sampleRate/2.0f) break;
+        freqs.push_back(f);
+    }
+
+    uint32_t numFFTBins = fftSize/2 + 1;
+    plan = plans.r2c(fftSize);
+    scratchIn = (float*) fftwf_malloc(sizeof(float) * fftSize);
+    scratchOut = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * numFFTBins);
+    float *imIn = (float*) fftwf_malloc(sizeof(float) * fftSize);
+    fftwf_complex *imOut = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * numFFTBins);
+    std::vector<float> band(2*numFFTBins);
+
+    offset.push_back(0);
+    for (float f : freqs) {
+        // Hann window scaled to unit sum, so a sinusoid of amplitude A gives |X| = A/2
+        uint32_t length = (uint32_t) std::ceil(q*sampleRate/f);
+        if (length > fftSize) length = fftSize;
+        uint32_t start = (fftSize - length)/2;
+        std::memset(scratchIn, 0, sizeof(float) * fftSize);
+        std::memset(imIn, 0, sizeof(float) * fftSize);
+        double sum = 0;
+        for (uint32_t m = 0; m < length; m++) sum += 0.5 - 0.5*std::cos(2*M_PI*m/length);
+        for (uint32_t m = 0; m < length; m++) {
+            double w = (0.5 - 0.5*std::cos(2*M_PI*m/length))/sum;
+            double phase = 2*M_PI*f*(start + m)/sampleRate;
+            scratchIn[start + m] = (float) (w*std::cos(phase));
+            imIn[start + m] = (float) (w*std::sin(phase));
+        }
+        fftwf_execute_dft_r2c(plan, scratchIn, scratchOut);
+        fftwf_execute_dft_r2c(plan, imIn, imOut);
+
+        // T = FFT(re) + i*FFT(im); store conj(T)/N for the Parseval sum
+        float peak = 0;
+        for (uint32_t j = 0; j < numFFTBins; j++) {
+            float re = scratchOut[j][0] - imOut[j][1];
+            float im = scratchOut[j][1] + imOut[j][0];
+            band[2*j] = re/fftSize;
+            band[2*j + 1] = -im/fftSize;
+            peak = std::fmax(peak, std::hypot(re, im));
+        }
+        float threshold = CQ_KERNEL_THRESHOLD*peak/fftSize;
+        uint32_t lo = 0, hi = numFFTBins;
+        while (lo < hi && std::hypot(band[2*lo], band[2*lo + 1]) < threshold) lo++;
+        while (hi > lo && std::hypot(band[2*(hi - 1)], band[2*(hi - 1) + 1]) < threshold) hi--;
+        first.push_back(lo);
+        kernel.insert(kernel.end(), band.begin() + 2*lo, band.begin() + 2*hi);
+        offset.push_back(kernel.size()/2);
+    }
+
+    fftwf_free(imOut);
+    fftwf_free(imIn);
+}
+
+ConstantQ::~ConstantQ() {
+    fftwf_free(scratchOut);
+    fftwf_free(scratchIn);
+}
+
+// Smallest power of two that holds the longest (lowest) kernel
+uint32_t ConstantQ::fftSizeFor(uint32_t sampleRate, float fMin, uint32_t binsPerOctave) {
+    if (binsPerOctave == 0) binsPerOctave = CQ_BINS_PER_OCTAVE;
+    double q = 1/(std::pow(2.0, 1.0/binsPerOctave) - 1);
+    double longest = fMin > 0 ? std::ceil(q*sampleRate/fMin) : (double) CQ_MAX_FFT_SIZE;
+    uint32_t size = 256;
+    while (size < longest && size < CQ_MAX_FFT_SIZE) size *= 2;
+    return size;
+}
+
+// sum(x[j]*k[j]) over n interleaved complex values; returns the real part
+float ConstantQ::dot(const float *x, const float *k, uint32_t n, float &im) const {
+    float re = 0;
+    im = 0;
+    uint32_t i = 0;
+#if defined(__AVX__)
+    __m256 vDirect = _mm256_setzero_ps();   // xr*kr, xi*ki pairs
+    __m256 vCross = _mm256_setzero_ps();    // xr*ki, xi*kr pairs
+    for (; i + 4 <= n; i += 4) {
+        __m256 a = _mm256_loadu_ps(&x[2*i]);
+        __m256 b = _mm256_loadu_ps(&k[2*i]);
+        vDirect = _mm256_add_ps(vDirect, _mm256_mul_ps(a, b));
+        vCross = _mm256_add_ps(vCross, _mm256_mul_ps(a, _mm256_permute_ps(b, _MM_SHUFFLE(2, 3, 0, 1))));
+    }
+    alignas(32) float direct[8], cross[8];
+    _mm256_store_ps(direct, vDirect);
+    _mm256_store_ps(cross, vCross);
+    for (uint32_t l = 0; l < 8; l += 2) {
+        re += direct[l] - direct[l + 1];
+        im += cross[l] + cross[l + 1];
+    }
+#elif defined(__SSE__)
+    __m128 vDirect = _mm_setzero_ps();
+    __m128 vCross = _mm_setzero_ps();
+    for (; i + 2 <= n; i += 2) {
+        __m128 a = _mm_loadu_ps(&x[2*i]);
+        __m128 b = _mm_loadu_ps(&k[2*i]);
+        vDirect = _mm_add_ps(vDirect, _mm_mul_ps(a, b));
+        vCross = _mm_add_ps(vCross, _mm_mul_ps(a, _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 3, 0, 1))));
+    }
+    alignas(16) float direct[4], cross[4];
+    _mm_store_ps(direct, vDirect);
+    _mm_store_ps(cross, vCross);
+    re = direct[0] - direct[1] + direct[2] - direct[3];
+    im = cross[0] + cross[1] + cross[2] + cross[3];
+#endif
+    for (; i < n; i++) {
+        re += x[2*i]*k[2*i] - x[2*i + 1]*k[2*i + 1];
+        im += x[2*i]*k[2*i + 1] + x[2*i + 1]*k[2*i];
+    }
+    return re;
+}
+
+// `spectrum` is the r2c output of getFFTSize() unwindowed samples; writes
+// getNumBins() levels on the display's 20*log10(amplitude) scale
+void ConstantQ::apply(const fftwf_complex *spectrum, float *dB) const {
+    const float *x = (const float*) spectrum;
+    for (uint32_t b = 0; b < freqs.size(); b++) {
+        float im;
+        float re = dot(&x[2*first[b]], &kernel[2*offset[b]], offset[b + 1] - offset[b], im);
+        dB[b] = powerToDB(4*(re*re + im*im));
+    }
+}
+
+// Transforms getFFTSize() samples and applies the kernels. Uses internal
+// scratch, so only one thread may call it.
+void ConstantQ::analyze(const float *samples, float *dB) {
+    std::memcpy(scratchIn, samples, sizeof(float) * fftSize);
+    fftwf_execute_dft_r2c(plan, scratchIn, scratchOut);
+    apply(scratchOut, dB);
+}
+
+uint32_t ConstantQ::getFFTSize() const {
+    return fftSize;
+}
+
+uint32_t ConstantQ::getNumBins() const {
+    return freqs.size();
+}
+
+float ConstantQ::getFrequency(uint32_t bin) const {
+    return freqs[bin];
+}
+
+// Complex multiply-adds per frame across all kernels
+uint32_t ConstantQ::getKernelTaps() const {
+    return offset.back();
+}
+
+FrequencyAxis ConstantQ::axis() const {
+    return FrequencyAxis::bins(freqs, true);
+}
+
+#endif
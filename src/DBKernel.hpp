@@ -0,0 +1,126 @@
+#ifndef DB_KERNEL_H
+#define DB_KERNEL_H
+
+#include <cstdint>
+#include <cstring>
+#include <fftw3.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// Spectrum magnitude -> dB without sqrt/pow/log10. The dB value is taken
+// from the power directly, 10*log10(scale*(re^2 + im^2)), with log2 split
+// into the float exponent plus a degree 5 Chebyshev fit of log2(1 + t) on
+// the mantissa. Max error is 1.5e-5 in log2, under 1e-4 dB once float
+// rounding is included.
+
+#define DB_LOG2_C0  1.439093e-05f
+#define DB_LOG2_C1  1.44159208f
+#define DB_LOG2_C2  -0.707253434f
+#define DB_LOG2_C3  0.411561482f
+#define DB_LOG2_C4  -0.189832447f
+#define DB_LOG2_C5  0.0439286278f
+
+#define DB_PER_LOG2     3.01029995664f  // 10*log10(2)
+#define DB_MIN_POWER    1e-30f          // floor so silent bins stay finite (-300 dB)
+
+float fastLog2(float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    float exponent = (float) ((int32_t) (bits >> 23) - 127);
+    bits = (bits & 0x007fffff) | 0x3f800000; // mantissa in [1, 2)
+    float m;
+    std::memcpy(&m, &bits, sizeof(m));
+    float t = m - 1;
+    float p = DB_LOG2_C5;
+    p = p*t + DB_LOG2_C4;
+    p = p*t + DB_LOG2_C3;
+    p = p*t + DB_LOG2_C2;
+    p = p*t + DB_LOG2_C1;
+    p = p*t + DB_LOG2_C0;
+    return exponent + p;
+}
+
+float powerToDB(float power) {
+    return DB_PER_LOG2*fastLog2(power < DB_MIN_POWER ? DB_MIN_POWER : power);
+}
+
+#if defined(__AVX2__)
+__m256 fastLog2(__m256 x) {
+    __m256i bits = _mm256_castps_si256(x);
+    __m256 exponent = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(127)));
+    bits = _mm256_or_si256(_mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff)), _mm256_set1_epi32(0x3f800000));
+    __m256 t = _mm256_sub_ps(_mm256_castsi256_ps(bits), _mm256_set1_ps(1));
+    __m256 p = _mm256_set1_ps(DB_LOG2_C5);
+    p = _mm256_add_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(DB_LOG2_C4));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(DB_LOG2_C3));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(DB_LOG2_C2));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(DB_LOG2_C1));
+    p = _mm256_add_ps(_mm256_mul_ps(p, t), _mm256_set1_ps(DB_LOG2_C0));
+    return _mm256_add_ps(exponent, p);
+}
+#elif defined(__SSE2__)
+__m128 fastLog2(__m128 x) {
+    __m128i bits = _mm_castps_si128(x);
+    __m128 exponent = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+    bits = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000));
+    __m128 t = _mm_sub_ps(_mm_castsi128_ps(bits), _mm_set1_ps(1));
+    __m128 p = _mm_set1_ps(DB_LOG2_C5);
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(DB_LOG2_C4));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(DB_LOG2_C3));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(DB_LOG2_C2));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(DB_LOG2_C1));
+    p = _mm_add_ps(_mm_mul_ps(p, t), _mm_set1_ps(DB_LOG2_C0));
+    return _mm_add_ps(exponent, p);
+}
+#endif
+
+// dB[i] = 10*log10(scale*|dft[i]|^2). For the amplitude-calibrated
+// 20*log10(2*|X|/N) used by the renderer pass scale = 4/N^2.
+void spectrumToDB(const fftwf_complex *dft, float *dB, uint32_t n, float scale) {
+    const float *c = (const float*) dft;
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    const __m256 vScale = _mm256_set1_ps(scale);
+    const __m256 vMin = _mm256_set1_ps(DB_MIN_POWER);
+    const __m256 vDB = _mm256_set1_ps(DB_PER_LOG2);
+    for (; i + 8 <= n; i += 8) {
+        __m256 a = _mm256_loadu_ps(&c[2*i]);       // bins i..i+3
+        __m256 b = _mm256_loadu_ps(&c[2*i + 8]);   // bins i+4..i+7
+        __m256 re = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 im = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        __m256 power = _mm256_add_ps(_mm256_mul_ps(re, re), _mm256_mul_ps(im, im));
+        // shuffle leaves bins ordered 0 1 4 5 2 3 6 7
+        power = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(power), _MM_SHUFFLE(3, 1, 2, 0)));
+        power = _mm256_max_ps(_mm256_mul_ps(power, vScale), vMin);
+        _mm256_storeu_ps(&dB[i], _mm256_mul_ps(fastLog2(power), vDB));
+    }
+#elif defined(__SSE2__)
+    const __m128 vScale = _mm_set1_ps(scale);
+    const __m128 vMin = _mm_set1_ps(DB_MIN_POWER);
+    const __m128 vDB = _mm_set1_ps(DB_PER_LOG2);
+    for (; i + 4 <= n; i += 4) {
+        __m128 a = _mm_loadu_ps(&c[2*i]);
+        __m128 b = _mm_loadu_ps(&c[2*i + 4]);
+        __m128 re = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 im = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 power = _mm_add_ps(_mm_mul_ps(re, re), _mm_mul_ps(im, im));
+        power = _mm_max_ps(_mm_mul_ps(power, vScale), vMin);
+        _mm_storeu_ps(&dB[i], _mm_mul_ps(fastLog2(power), vDB));
+    }
+#endif
+    for (; i < n; i++) {
+        float re = c[2*i], im = c[2*i + 1];
+        dB[i] = powerToDB(scale*(re*re + im*im));
+    }
+}
+
+// Scale factor for spectrumToDB matching 20*log10(2*|X|/fftSize)
+float amplitudeScale(uint32_t fftSize) {
+    return 4.0f/((float) fftSize*fftSize);
+}
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef DEINTERLEAVE_H
+#define DEINTERLEAVE_H
+
+#include <cstdint>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+// Interleaved frames -> one plane per channel, out[c][f] = in[f*numChannels + c].
+// Groups of 8 channels x 8 frames (4 x 4 without AVX) go through an
+// in-register transpose, so each input cache line is read once and every
+// store is a full vector. Leftover channels and frames are copied one at a
+// time. A nonzero FixedChannels makes the stride a compile-time constant.
+template <uint32_t FixedChannels>
+void deinterleaveN(const float *in, float *const *out, uint32_t channels, uint32_t frames) {
+    const uint32_t numChannels = FixedChannels != 0 ? FixedChannels : channels;
+    uint32_t c = 0;
+#if defined(__AVX__)
+    for (; c + 8 <= numChannels; c += 8) {
+        uint32_t f = 0;
+        for (; f + 8 <= frames; f += 8) {
+            const float *src = &in[f*numChannels + c];
+            __m256 r0 = _mm256_loadu_ps(src);
+            __m256 r1 = _mm256_loadu_ps(src + numChannels);
+            __m256 r2 = _mm256_loadu_ps(src + 2*numChannels);
+            __m256 r3 = _mm256_loadu_ps(src + 3*numChannels);
+            __m256 r4 = _mm256_loadu_ps(src + 4*numChannels);
+            __m256 r5 = _mm256_loadu_ps(src + 5*numChannels);
+            __m256 r6 = _mm256_loadu_ps(src + 6*numChannels);
+            __m256 r7 = _mm256_loadu_ps(src + 7*numChannels);
+
+            __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpackhi_ps(r0, r1);
+            __m256 t2 = _mm256_unpacklo_ps(r2, r3), t3 = _mm256_unpackhi_ps(r2, r3);
+            __m256 t4 = _mm256_unpacklo_ps(r4, r5), t5 = _mm256_unpackhi_ps(r4, r5);
+            __m256 t6 = _mm256_unpacklo_ps(r6, r7), t7 = _mm256_unpackhi_ps(r6, r7);
+
+            __m256 s0 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 s1 = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+            __m256 s2 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 s3 = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+            __m256 s4 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 s5 = _mm256_shuffle_ps(t4, t6, _MM_SHUFFLE(3, 2, 3, 2));
+            __m256 s6 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(1, 0, 1, 0));
+            __m256 s7 = _mm256_shuffle_ps(t5, t7, _MM_SHUFFLE(3, 2, 3, 2));
+
+            // Low 128 bits hold frames f..f+3, high bits f+4..f+7
+            _mm256_storeu_ps(&out[c][f], _mm256_permute2f128_ps(s0, s4, 0x20));
+            _mm256_storeu_ps(&out[c + 1][f], _mm256_permute2f128_ps(s1, s5, 0x20));
+            _mm256_storeu_ps(&out[c + 2][f], _mm256_permute2f128_ps(s2, s6, 0x20));
+            _mm256_storeu_ps(&out[c + 3][f], _mm256_permute2f128_ps(s3, s7, 0x20));
+            _mm256_storeu_ps(&out[c + 4][f], _mm256_permute2f128_ps(s0, s4, 0x31));
+            _mm256_storeu_ps(&out[c + 5][f], _mm256_permute2f128_ps(s1, s5, 0x31));
+            _mm256_storeu_ps(&out[c + 6][f], _mm256_permute2f128_ps(s2, s6, 0x31));
+            _mm256_storeu_ps(&out[c + 7][f], _mm256_permute2f128_ps(s3, s7, 0x31));
+        }
+        for (; f < frames; f++) {
+            for (uint32_t k = 0; k < 8; k++) out[c + k][f] = in[f*numChannels + c + k];
+        }
+    }
+#elif defined(__SSE__)
+    for (; c + 4 <= numChannels; c += 4) {
+        uint32_t f = 0;
+        for (; f + 4 <= frames; f += 4) {
+            const float *src = &in[f*numChannels + c];
+            __m128 r0 = _mm_loadu_ps(src);
+            __m128 r1 = _mm_loadu_ps(src + numChannels);
+            __m128 r2 = _mm_loadu_ps(src + 2*numChannels);
+            __m128 r3 = _mm_loadu_ps(src + 3*numChannels);
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            _mm_storeu_ps(&out[c][f], r0);
+            _mm_storeu_ps(&out[c + 1][f], r1);
+            _mm_storeu_ps(&out[c + 2][f], r2);
+            _mm_storeu_ps(&out[c + 3][f], r3);
+        }
+        for (; f < frames; f++) {
+            for (uint32_t k = 0; k < 4; k++) out[c + k][f] = in[f*numChannels + c + k];
+        }
+    }
+#endif
+    for (; c < numChannels; c++) {
+        for (uint32_t f = 0; f < frames; f++) out[c][f] = in[f*numChannels + c];
+    }
+}
+
+// Common array sizes get their own instantiation, anything else the
+// generic version
+void deinterleave(const float *in, float *const *out, uint32_t numChannels, uint32_t frames) {
+    switch (numChannels) {
+        case 2:  deinterleaveN<2>(in, out, numChannels, frames); break;
+        case 4:  deinterleaveN<4>(in, out, numChannels, frames); break;
+        case 8:  deinterleaveN<8>(in, out, numChannels, frames); break;
+        case 16: deinterleaveN<16>(in, out, numChannels, frames); break;
+        case 32: deinterleaveN<32>(in, out, numChannels, frames); break;
+        default: deinterleaveN<0>(in, out, numChannels, frames); break;
+    }
+}
+
+// int16 frames are half the bytes, and a plain copy loop keeps up with
+// any capture rate
+void deinterleave(const int16_t *in, int16_t *const *out, uint32_t numChannels, uint32_t frames) {
+    for (uint32_t c = 0; c < numChannels; c++) {
+        for (uint32_t f = 0; f < frames; f++) out[c][f] = in[f*numChannels + c];
+    }
+}
+
+#endif
@@ -0,0 +1,119 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <sys/mman.h>
+
+#define ARENA_ALIGN         64              // cache line, and enough for any SIMD load or FFTW's aligned plans
+#define ARENA_CHUNK_BYTES   (2 << 20)       // one x86 huge page
+#define HUGE_PAGE_BYTES     (2 << 20)
+
+// Bump allocator for buffers that live as long as the stage owning them:
+// frame pools, history, per-worker FFT scratch. Memory comes from the
+// kernel in ARENA_CHUNK_BYTES mappings and is only returned when the arena
+// is destroyed, so nothing allocated here ever touches the heap again.
+// With `hugePages` each chunk is first tried as an explicit huge page
+// mapping, then falls back to asking for transparent huge pages. Not
+// thread safe; allocate before starting the threads that use the memory.
+class FrameArena {
+    public:
+        FrameArena(bool _hugePages = false, size_t _chunkBytes = ARENA_CHUNK_BYTES);
+        FrameArena(const FrameArena&) = delete;
+        FrameArena& operator=(const FrameArena&) = delete;
+        ~FrameArena();
+
+        template <typename T> T* allocate(size_t count);
+        void* allocateBytes(size_t bytes);
+
+        size_t getUsed() const;
+        size_t getReserved() const;
+        uint32_t getHugeChunks() const;
+    private:
+        struct Chunk {
+            uint8_t *base;
+            size_t size;
+        };
+
+        bool grow(size_t bytes);
+
+        bool hugePages;
+        size_t chunkBytes;
+        std::vector<Chunk> chunks;
+        size_t offset = 0;              // into the last chunk
+        size_t used = 0;
+        uint32_t hugeChunks = 0;        // chunks backed by explicit huge pages
+};
+
+FrameArena::FrameArena(bool _hugePages, size_t _chunkBytes)
+    : hugePages(_hugePages),
+      chunkBytes((_chunkBytes + ARENA_ALIGN - 1)/ARENA_ALIGN*ARENA_ALIGN)
+{ }
+
+FrameArena::~FrameArena() {
+    for (Chunk &chunk : chunks) munmap(chunk.base, chunk.size);
+}
+
+// `count` zeroed, ARENA_ALIGN aligned elements, nullptr if out of memory.
+// Only for types that need no destructor.
+template <typename T>
+T* FrameArena::allocate(size_t count) {
+    return (T*) allocateBytes(sizeof(T) * count);
+}
+
+void* FrameArena::allocateBytes(size_t bytes) {
+    bytes = (bytes + ARENA_ALIGN - 1)/ARENA_ALIGN*ARENA_ALIGN;
+    if (bytes == 0) bytes = ARENA_ALIGN;
+    if (chunks.empty() || offset + bytes > chunks.back().size) {
+        if (!grow(bytes)) return nullptr;
+    }
+    void *p = chunks.back().base + offset;
+    offset += bytes;
+    used += bytes;
+    return p;
+}
+
+// Maps a new chunk large enough for `bytes`. What was left of the previous
+// chunk is abandoned; allocations are few and large, so little is lost.
+bool FrameArena::grow(size_t bytes) {
+    size_t size = bytes > chunkBytes ? bytes : chunkBytes;
+    void *addr = MAP_FAILED;
+    bool huge = false;
+    if (hugePages) {
+        size = (size + HUGE_PAGE_BYTES - 1)/HUGE_PAGE_BYTES*HUGE_PAGE_BYTES;
+#if defined(MAP_HUGETLB)
+        addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        huge = addr != MAP_FAILED;
+#endif
+    }
+    if (addr == MAP_FAILED) addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (addr == MAP_FAILED) {
+        std::cout << "Failed to map " << size << " bytes for the frame arena" << std::endl;
+        return false;
+    }
+#if defined(MADV_HUGEPAGE)
+    if (hugePages && !huge) madvise(addr, size, MADV_HUGEPAGE);
+#endif
+    chunks.push_back({(uint8_t*) addr, size});
+    offset = 0;
+    if (huge) hugeChunks++;
+    return true;
+}
+
+size_t FrameArena::getUsed() const {
+    return used;
+}
+
+size_t FrameArena::getReserved() const {
+    size_t total = 0;
+    for (const Chunk &chunk : chunks) total += chunk.size;
+    return total;
+}
+
+uint32_t FrameArena::getHugeChunks() const {
+    return hugeChunks;
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <fftw3.h>
+
+#include "BoundedQueue.hpp"
+#include "FrameArena.hpp"
+#include "Stats.hpp"
+
+struct SpectrumFrame {
+    uint64_t seq;
+    TimePoint delivered;    // audio callback that last fed the recorder
+    TimePoint captured;     // window completed by the capture stage
+    TimePoint dspStart;
+    TimePoint dspDone;
+    float *samples;         // fftSize time samples
+    fftwf_complex *spectrum;    // fftSize/2 + 1 bins, unscaled r2c output
+    float *dB;              // fftSize/2 + 1 magnitudes
+    std::atomic<uint32_t> refs{0};
+};
+
+// Fixed set of SpectrumFrames whose buffers are carved out of a FrameArena
+// once. Frames are handed out with one reference; any stage that keeps a
+// frame past handing it on takes another with retain(), and the frame goes
+// back on the free list when the last holder releases it. Steady state
+// only moves pointers between queues.
+class FramePool {
+    public:
+        FramePool(FrameArena &arena, uint32_t numFrames, uint32_t fftSize);
+        FramePool(const FramePool&) = delete;
+        FramePool& operator=(const FramePool&) = delete;
+
+        SpectrumFrame* acquire();
+        void retain(SpectrumFrame *frame);
+        void release(SpectrumFrame *frame);
+
+        uint32_t available();
+        uint32_t getNumFrames() const;
+    private:
+        std::vector<SpectrumFrame> frames;
+        BoundedQueue<SpectrumFrame*> freeFrames;
+};
+
+FramePool::FramePool(FrameArena &arena, uint32_t numFrames, uint32_t fftSize)
+    : frames(numFrames),
+      freeFrames(numFrames)
+{
+    uint32_t numBins = fftSize/2 + 1;
+    for (SpectrumFrame &frame : frames) {
+        frame.seq = 0;
+        frame.samples = arena.allocate<float>(fftSize);
+        frame.spectrum = arena.allocate<fftwf_complex>(numBins);
+        frame.dB = arena.allocate<float>(numBins);
+        freeFrames.push(&frame);
+    }
+}
+
+// A free frame holding one reference, nullptr if all are in use
+SpectrumFrame* FramePool::acquire() {
+    SpectrumFrame *frame;
+    if (!freeFrames.tryPop(frame)) return nullptr;
+    frame->refs.store(1, std::memory_order_relaxed);
+    return frame;
+}
+
+void FramePool::retain(SpectrumFrame *frame) {
+    frame->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+// The holder's writes to the frame happen before whoever acquires it next
+void FramePool::release(SpectrumFrame *frame) {
+    if (frame->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) freeFrames.tryPush(frame);
+}
+
+uint32_t FramePool::available() {
+    return freeFrames.size();
+}
+
+uint32_t FramePool::getNumFrames() const {
+    return frames.size();
+}
+
+#endif
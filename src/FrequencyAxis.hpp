@@ -0,0 +1,127 @@
+#ifndef FREQUENCY_AXIS_H
+#define FREQUENCY_AXIS_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#define LOG_AXIS_MIN_HZ 20  // lowest frequency a log axis over FFT bins shows
+
+// Maps spectrum bins onto a display axis, linear or logarithmic in
+// frequency. Bins are described by their centre frequencies, ascending, so
+// the same axis serves FFT bins and constant-Q bins. Displays split the
+// axis into equal slots (bars, texture rows) and show the peak of the bins
+// in each slot; where a log axis is finer than the bins, a slot repeats
+// the nearest bin.
+struct FrequencyAxis {
+    std::vector<float> freqs;   // centre of each bin, Hz
+    bool logScale = false;
+    float lo = 0, hi = 1;       // frequencies at the two ends of the axis
+
+    static FrequencyAxis fft(uint32_t numBins, float binWidth, bool logScale);
+    static FrequencyAxis bins(const std::vector<float> &freqs, bool logScale);
+
+    uint32_t numBins() const;
+    float position(float freq) const;
+    float frequencyAt(float position) const;
+    float labelFrequency(uint32_t i, uint32_t count) const;
+    void group(uint32_t slots, std::vector<uint32_t> &begin, std::vector<uint32_t> &end) const;
+};
+
+bool parseFrequencyAxis(const char *name, bool &logScale) {
+    if (strcmp(name, "linear") == 0) logScale = false;
+    else if (strcmp(name, "log") == 0) logScale = true;
+    else return false;
+    return true;
+}
+
+// Bins 0..numBins-1 of an FFT. A linear axis gives every bin an equal
+// share; a log axis can not show DC and starts at LOG_AXIS_MIN_HZ.
+FrequencyAxis FrequencyAxis::fft(uint32_t numBins, float binWidth, bool logScale) {
+    FrequencyAxis axis;
+    axis.freqs.resize(numBins);
+    for (uint32_t i = 0; i < numBins; i++) axis.freqs[i] = i*binWidth;
+    axis.logScale = logScale;
+    axis.lo = logScale ? std::max((float) LOG_AXIS_MIN_HZ, binWidth/2) : -binWidth/2;
+    axis.hi = (numBins - 0.5f)*binWidth;
+    return axis;
+}
+
+// Arbitrary ascending bin centres, with half a bin spacing beyond each end
+FrequencyAxis FrequencyAxis::bins(const std::vector<float> &freqs, bool logScale) {
+    FrequencyAxis axis;
+    axis.freqs = freqs;
+    axis.logScale = logScale;
+    size_t n = freqs.size();
+    if (n < 2) {
+        axis.lo = n == 1 ? freqs[0]/2 : 0;
+        axis.hi = n == 1 ? freqs[0]*2 : 1;
+    } else if (logScale) {
+        axis.lo = freqs[0]*std::sqrt(freqs[0]/freqs[1]);
+        axis.hi = freqs[n - 1]*std::sqrt(freqs[n - 1]/freqs[n - 2]);
+    } else {
+        axis.lo = freqs[0] - (freqs[1] - freqs[0])/2;
+        axis.hi = freqs[n - 1] + (freqs[n - 1] - freqs[n - 2])/2;
+    }
+    return axis;
+}
+
+uint32_t FrequencyAxis::numBins() const {
+    return freqs.size();
+}
+
+// 0 at `lo` to 1 at `hi`; frequencies at or below 0 on a log axis map
+// far off the low end
+float FrequencyAxis::position(float freq) const {
+    if (!logScale) return (freq - lo)/(hi - lo);
+    if (freq <= 0) return -INFINITY;
+    return std::log(freq/lo)/std::log(hi/lo);
+}
+
+float FrequencyAxis::frequencyAt(float p) const {
+    if (!logScale) return lo + p*(hi - lo);
+    return lo*std::pow(hi/lo, p);
+}
+
+// The i-th of `count` axis labels: evenly spaced from 0 Hz (or the low end)
+// to the top bin on a linear axis, geometrically spaced end to end on a
+// log axis
+float FrequencyAxis::labelFrequency(uint32_t i, uint32_t count) const {
+    if (count < 2) return lo;
+    float t = (float) i/(count - 1);
+    if (logScale) return frequencyAt(t);
+    float from = lo > 0 ? lo : 0, to = freqs.empty() ? hi : freqs.back();
+    return from + t*(to - from);
+}
+
+// Splits the axis into `slots` equal parts and gives each the range of
+// bins [begin, end) to take the peak of. Every range holds at least one
+// bin.
+void FrequencyAxis::group(uint32_t slots, std::vector<uint32_t> &begin, std::vector<uint32_t> &end) const {
+    begin.assign(slots, 0);
+    end.assign(slots, 0);
+    uint32_t n = numBins();
+    if (n == 0) return;
+    for (uint32_t b = 0; b < n; b++) {
+        float p = position(freqs[b]);
+        if (!(p >= 0 && p < 1)) continue;
+        uint32_t s = (uint32_t) (p*slots);
+        if (s >= slots) continue;
+        if (end[s] == 0) begin[s] = b;
+        end[s] = b + 1;
+    }
+    for (uint32_t s = 0; s < slots; s++) {
+        if (end[s] != 0) continue;
+        float f = frequencyAt((s + 0.5f)/slots);
+        uint32_t b = std::lower_bound(freqs.begin(), freqs.end(), f) - freqs.begin();
+        // Nearer neighbour, by ratio on a log axis
+        if (b == n) b--;
+        else if (b > 0 && (logScale ? f*f < freqs[b - 1]*freqs[b] : 2*f < freqs[b - 1] + freqs[b])) b--;
+        begin[s] = b;
+        end[s] = b + 1;
+    }
+}
+
+#endif
@@ -4,46 +4,76 @@
 #include <cstdint>
 #include <cmath>
 
-class LPF {
+#include "Biquad.hpp"
+
+class LPF : public Biquad {
     public:
         LPF(uint32_t fs, uint32_t f0, float q);
-        ~LPF();
-        float process(float x);
     private:
         uint32_t fs, f0;
         float q;
-        float a0, a1, a2, b0, b1, b2;
-        float x1, x2, y1, y2;
 };
 
-LPF::LPF(uint32_t samplingFrequency, uint32_t cutoffFrequency, float qualityFactor) {
-    // User defined parameters
-    fs = samplingFrequency;
-    f0 = cutoffFrequency;
-    q = qualityFactor;
-
-    // Intermediate variables
-    float omega = 2*M_PI*f0/fs;
-    float cosOmega = cos(omega);
-    float sinOmega = sin(omega);
-    float alpha = sinOmega/(2*q);
-
-    // Compute coefficients
-    b0 = (1 - cosOmega)/2;
-    b1 = 1 - cosOmega;
-    b2 = b0;
-    a0 = 1 + alpha;
-    a1 = -2*cosOmega;
-    a2 = 1 - alpha;
+LPF::LPF(uint32_t samplingFrequency, uint32_t cutoffFrequency, float qualityFactor)
+    : Biquad(BiquadType::LowPass, samplingFrequency, cutoffFrequency, qualityFactor),
+      fs(samplingFrequency),
+      f0(cutoffFrequency),
+      q(qualityFactor)
+{ }
+
+#define Q30_SHIFT   30
+
+// Low-pass for int16 (Q15) streams. Coefficients are Q2.30 so a1 up to
+// -2 fits, the sum runs in a 64 bit accumulator, and the bits dropped when
+// narrowing the output are fed into the next two samples (second-order
+// error feedback). That puts a double zero at DC in the rounding noise, right
+// where a low cutoff's poles would otherwise amplify it. Output saturates
+// to int16.
+class LPFQ15 {
+    public:
+        LPFQ15(uint32_t fs, uint32_t f0, float q);
+        int16_t process(int16_t x);
+        void processBlock(const int16_t *input, int16_t *output, uint32_t n);
+        void reset();
+    private:
+        int32_t b0, b1, b2, a1, a2;
+        int16_t x1, x2, y1, y2;
+        int64_t err1, err2;             // fractions dropped from the last two outputs
+};
+
+LPFQ15::LPFQ15(uint32_t samplingFrequency, uint32_t cutoffFrequency, float qualityFactor) {
+    BiquadCoeffs c = BiquadCoeffs::design(BiquadType::LowPass, samplingFrequency, cutoffFrequency, qualityFactor);
+    b0 = (int32_t) std::lround(c.b0 * (double) (1 << Q30_SHIFT));
+    b1 = (int32_t) std::lround(c.b1 * (double) (1 << Q30_SHIFT));
+    b2 = (int32_t) std::lround(c.b2 * (double) (1 << Q30_SHIFT));
+    a1 = (int32_t) std::lround(c.a1 * (double) (1 << Q30_SHIFT));
+    a2 = (int32_t) std::lround(c.a2 * (double) (1 << Q30_SHIFT));
+    reset();
+}
+
+void LPFQ15::reset() {
+    x1 = x2 = y1 = y2 = 0;
+    err1 = err2 = 0;
 }
 
-float LPF::process(float x) {
-    float y = (b0/a0)*x + (b1/a0)*x1 + (b2/a0)*x2 - (a1/a0)*y1 - (a2/a0)*y2;
+// Direct form I: only the int16 inputs and outputs are kept as state
+int16_t LPFQ15::process(int16_t x) {
+    int64_t acc = 2*err1 - err2 + (int64_t) b0*x + (int64_t) b1*x1 + (int64_t) b2*x2
+                      - (int64_t) a1*y1 - (int64_t) a2*y2;
+    int64_t y = acc >> Q30_SHIFT;
+    err2 = err1;
+    err1 = acc & ((INT64_C(1) << Q30_SHIFT) - 1);  // what the floor dropped
+    if (y > INT16_MAX) y = INT16_MAX;
+    else if (y < INT16_MIN) y = INT16_MIN;
     x2 = x1;
     x1 = x;
     y2 = y1;
-    y1 = y;
-    return y;
+    y1 = (int16_t) y;
+    return y1;
+}
+
+void LPFQ15::processBlock(const int16_t *input, int16_t *output, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) output[i] = process(input[i]);
 }
 
 #endif
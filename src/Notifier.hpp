@@ -0,0 +1,50 @@
+#ifndef NOTIFIER_H
+#define NOTIFIER_H
+
+#include <atomic>
+#include <cstdint>
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Futex-backed event counter. notify() never blocks and skips the syscall
+// when nobody is waiting, so it is safe to call from the audio callback.
+class Notifier {
+    public:
+        void notify();
+        uint32_t wait(uint32_t lastSeen, uint32_t timeoutMs);
+        uint32_t current() const;
+    private:
+        std::atomic<uint32_t> seq{0};
+        std::atomic<uint32_t> waiters{0};
+};
+
+void Notifier::notify() {
+    seq.fetch_add(1, std::memory_order_release);
+    if (waiters.load(std::memory_order_acquire) > 0) {
+        syscall(SYS_futex, (uint32_t*) &seq, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
+}
+
+// Sleeps until the counter moves past `lastSeen` or the timeout expires.
+// Returns the counter value seen on wakeup.
+uint32_t Notifier::wait(uint32_t lastSeen, uint32_t timeoutMs) {
+    uint32_t now = seq.load(std::memory_order_acquire);
+    if (now != lastSeen) return now;
+
+    struct timespec timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+    waiters.fetch_add(1, std::memory_order_acq_rel);
+    syscall(SYS_futex, (uint32_t*) &seq, FUTEX_WAIT_PRIVATE, lastSeen, &timeout, nullptr, 0);
+    waiters.fetch_sub(1, std::memory_order_acq_rel);
+    return seq.load(std::memory_order_acquire);
+}
+
+uint32_t Notifier::current() const {
+    return seq.load(std::memory_order_acquire);
+}
+
+#endif
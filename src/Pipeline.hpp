@@ -0,0 +1,374 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fftw3.h>
+
+#include "BoundedQueue.hpp"
+#include "CircularBuffer.hpp"
+#include "ConstantQ.hpp"
+#include "DBKernel.hpp"
+#include "FrameArena.hpp"
+#include "FramePool.hpp"
+#include "PlanRegistry.hpp"
+#include "Recorder.hpp"
+#include "Resampler.hpp"
+#include "SlidingDFT.hpp"
+#include "SpectrumAverager.hpp"
+#include "STFT.hpp"
+#include "Span.hpp"
+#include "Stats.hpp"
+
+#define CAPTURE_WAIT_MS 50
+
+// Live analysis in three stages connected by bounded queues:
+//   capture thread -> DSP worker pool -> render (caller's thread)
+// Frames come from a refcounted FramePool and are recycled, and every
+// other buffer (window, history, per-worker FFT input) is carved from the
+// same FrameArena up front, so steady state does not allocate. Every stage
+// sleeps on its queue or on the recorder's futex rather than polling. If
+// the renderer falls behind only the newest frame is drawn; if the workers
+// fall behind, new windows are dropped and counted.
+// Each pipeline analyzes one recorder channel; run one per channel to
+// process an array in parallel.
+class Pipeline {
+    public:
+        Pipeline(PlanRegistry &plans, Recorder &recorder, uint32_t fftSize, uint32_t hopSize,
+                 WindowType windowType = WindowType::Hann, uint32_t numWorkers = 2,
+                 uint32_t numFrames = 16, uint32_t channel = 0, FrameArena *arena = nullptr);
+        Pipeline(const Pipeline&) = delete;
+        Pipeline& operator=(const Pipeline&) = delete;
+        ~Pipeline();
+
+        void start();
+        void stop();
+        bool isRunning() const;
+        void setInputStage(ResampleChain *stage);
+        void setTracker(SlidingDFT *_tracker);
+        void setAverager(SpectrumAverager *_averager);
+        bool setConstantQ(ConstantQ *_constantQ);
+        bool trackedLevels(float *dB);
+
+        SpectrumFrame* acquireLatest(std::chrono::microseconds timeout);
+        void release(SpectrumFrame *frame);
+        void retain(SpectrumFrame *frame);
+        void releaseRetained(SpectrumFrame *frame);
+
+        uint64_t getDropped() const;
+        void writeStats(std::ostream &out) const;
+        void printStats() const;
+
+        StageLatency capture;       // audio callback -> window completed
+        StageLatency dspQueue;      // captured -> picked up by a worker
+        StageLatency dsp;           // window + FFT + dB
+        StageLatency fft;           // FFT alone
+        StageLatency renderQueue;   // DSP done -> picked up by the renderer
+        StageLatency render;        // picked up -> released by the renderer
+        StageLatency endToEnd;      // audio callback -> released by the renderer
+    private:
+        void captureLoop();
+        void dspLoop(float *input);
+        void drain(BoundedQueue<SpectrumFrame*> &queue);
+
+        PlanRegistry &plans;
+        Recorder &recorder;
+        std::unique_ptr<FrameArena> ownArena;   // when the caller shares none
+        FrameArena &arena;
+        uint32_t fftSize, hopSize, numBins, numWorkers;
+        uint32_t channel;
+        ResampleChain *inputStage = nullptr;
+        SlidingDFT *tracker = nullptr;
+        SpectrumAverager *averager = nullptr;   // render thread only
+        const ConstantQ *constantQ = nullptr;
+        std::mutex trackedMutex;
+        std::vector<float> trackedDB;   // latest tracker levels, published per capture chunk
+        float *window;
+        float *historyData;             // fftSize, for the capture thread's ring
+        float *hopData;                 // hopSize
+        std::vector<float*> fftIn;      // fftSize per worker, each aligned for the plan
+        fftwf_plan plan;
+
+        FramePool pool;
+        BoundedQueue<SpectrumFrame*> jobs, ready;
+        TimePoint acquired;
+        uint64_t lastRendered = 0;
+
+        std::thread captureThread;
+        std::vector<std::thread> workers;
+        std::atomic<bool> running{false};
+        std::atomic<uint64_t> dropped{0};
+};
+
+Pipeline::Pipeline(PlanRegistry &_plans, Recorder &_recorder, uint32_t _fftSize, uint32_t _hopSize,
+                   WindowType windowType, uint32_t _numWorkers, uint32_t numFrames, uint32_t _channel,
+                   FrameArena *_arena)
+    : plans(_plans),
+      recorder(_recorder),
+      ownArena(_arena == nullptr ? std::make_unique<FrameArena>() : nullptr),
+      arena(_arena == nullptr ? *ownArena : *_arena),
+      fftSize(_fftSize),
+      hopSize(_hopSize == 0 || _hopSize > _fftSize ? _fftSize : _hopSize),
+      numBins(_fftSize/2 + 1),
+      numWorkers(_numWorkers == 0 ? 1 : _numWorkers),
+      channel(_channel),
+      window(arena.allocate<float>(_fftSize)),
+      historyData(arena.allocate<float>(_fftSize)),
+      hopData(arena.allocate<float>(hopSize)),
+      pool(arena, numFrames, _fftSize),
+      jobs(numFrames),
+      ready(numFrames)
+{
+    // Separate blocks, so every worker's input starts on ARENA_ALIGN
+    // whatever the fft size
+    for (uint32_t i = 0; i < numWorkers; i++) fftIn.push_back(arena.allocate<float>(fftSize));
+    STFT::computeWindow(windowType, 8.6f, window, fftSize);
+    plan = plans.r2c(fftSize);
+    recorder.addReader(channel);
+}
+
+Pipeline::~Pipeline() {
+    stop();
+}
+
+void Pipeline::start() {
+    if (running) return;
+    running = true;
+    lastRendered = 0;   // seq restarts with the capture thread
+    jobs.reopen();
+    ready.reopen();
+    captureThread = std::thread(&Pipeline::captureLoop, this);
+    for (uint32_t i = 0; i < numWorkers; i++) {
+        workers.emplace_back(&Pipeline::dspLoop, this, fftIn[i]);
+    }
+}
+
+void Pipeline::stop() {
+    if (!running) return;
+    running = false;
+    if (captureThread.joinable()) captureThread.join();
+    jobs.close();
+    for (std::thread &worker : workers) worker.join();
+    workers.clear();
+    ready.close();
+
+    // Return everything still in flight to the pool
+    drain(jobs);
+    drain(ready);
+}
+
+void Pipeline::drain(BoundedQueue<SpectrumFrame*> &queue) {
+    SpectrumFrame *frame;
+    while (queue.tryPop(frame)) pool.release(frame);
+}
+
+bool Pipeline::isRunning() const {
+    return running;
+}
+
+// Runs captured samples through `stage` (e.g. a decimator down to the
+// analysis rate) before windowing. Only call while stopped; the stage is
+// then used from the capture thread alone.
+void Pipeline::setInputStage(ResampleChain *stage) {
+    if (running) return;
+    inputStage = stage;
+}
+
+// Also feeds every analysis-rate sample through `tracker`, for bins that
+// need per-sample updates. Only call while stopped.
+void Pipeline::setTracker(SlidingDFT *_tracker) {
+    if (running) return;
+    tracker = _tracker;
+    std::lock_guard<std::mutex> lock(trackedMutex);
+    trackedDB.assign(tracker != nullptr ? tracker->getNumBins() : 0, -INFINITY);
+}
+
+// Folds every finished frame into `averager` and hands out its aggregate
+// in place of the newest frame's own spectrum. Only call while stopped.
+void Pipeline::setAverager(SpectrumAverager *_averager) {
+    if (running) return;
+    averager = _averager;
+}
+
+// Frames then hold constantQ->getNumBins() log-spaced levels instead of
+// the linear spectrum. The pipeline's fftSize must be the transform's FFT
+// size. Only call while stopped.
+bool Pipeline::setConstantQ(ConstantQ *_constantQ) {
+    if (running) return false;
+    if (_constantQ != nullptr && _constantQ->getFFTSize() != fftSize) {
+        std::cout << "Failed to use constant-Q analysis, it needs fft-size " << _constantQ->getFFTSize() << std::endl;
+        return false;
+    }
+    constantQ = _constantQ;
+    return true;
+}
+
+// Copies the tracker's most recent levels, false without a tracker
+bool Pipeline::trackedLevels(float *dB) {
+    std::lock_guard<std::mutex> lock(trackedMutex);
+    if (trackedDB.empty()) return false;
+    std::memcpy(dB, trackedDB.data(), sizeof(float) * trackedDB.size());
+    return true;
+}
+
+void Pipeline::captureLoop() {
+    CircularBuffer<float> history(Span<float>(historyData, fftSize));
+    std::vector<float> staged(inputStage != nullptr ? inputStage->maxOutput(hopSize) : 0);
+    uint32_t untilNext = fftSize;
+    uint64_t seq = 0;
+    uint32_t lastSeen = recorder.dataNotifier().current();
+
+    while (running) {
+        int n = recorder.readStream(hopData, hopSize, channel);
+        if (n <= 0) {
+            lastSeen = recorder.dataNotifier().wait(lastSeen, CAPTURE_WAIT_MS);
+            continue;
+        }
+
+        const float *src = hopData;
+        if (inputStage != nullptr) {
+            n = inputStage->process(hopData, n, staged.data());
+            src = staged.data();
+        }
+        if (tracker != nullptr) {
+            tracker->update(src, n);
+            std::lock_guard<std::mutex> lock(trackedMutex);
+            tracker->levels(trackedDB.data());
+        }
+        while (n > 0) {
+            uint32_t take = (uint32_t) n <= untilNext ? n : untilNext;
+            history.write(Span<const float>(src, take));
+            untilNext -= take;
+            src += take;
+            n -= take;
+            if (untilNext > 0) break;
+
+            SpectrumFrame *frame = pool.acquire();
+            if (frame != nullptr) {
+                history.peekLatest(fftSize).copyTo(frame->samples);
+                frame->seq = ++seq;
+                frame->delivered = recorder.lastCallback();
+                frame->captured = std::chrono::steady_clock::now();
+                capture.record(frame->delivered, frame->captured);
+                jobs.push(frame);
+            } else {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+            untilNext = hopSize;
+        }
+    }
+}
+
+// `input` is this worker's fftIn block
+void Pipeline::dspLoop(float *input) {
+    SpectrumFrame *frame;
+    while (jobs.pop(frame)) {
+        frame->dspStart = std::chrono::steady_clock::now();
+        dspQueue.record(frame->captured, frame->dspStart);
+
+        // Constant-Q kernels carry their own windows
+        float *fftInput = frame->samples;
+        if (constantQ == nullptr) {
+            applyWindow(frame->samples, window, input, fftSize);
+            fftInput = input;
+        }
+        TimePoint fftStart = std::chrono::steady_clock::now();
+        fftwf_execute_dft_r2c(plan, fftInput, frame->spectrum);
+        fft.record(fftStart, std::chrono::steady_clock::now());
+        if (constantQ != nullptr) constantQ->apply(frame->spectrum, frame->dB);
+        else spectrumToDB(frame->spectrum, frame->dB, numBins, amplitudeScale(fftSize));
+
+        frame->dspDone = std::chrono::steady_clock::now();
+        dsp.record(frame->dspStart, frame->dspDone);
+        if (!ready.tryPush(frame)) pool.release(frame);
+    }
+}
+
+// Waits up to `timeout` for a finished frame and returns the newest one,
+// recycling any older frames that queued up behind it. Returns nullptr on
+// timeout. The frame must be handed back with release(). With an averager
+// the skipped frames still count towards the average.
+SpectrumFrame* Pipeline::acquireLatest(std::chrono::microseconds timeout) {
+    SpectrumFrame *newest = nullptr, *frame;
+    if (!ready.popFor(frame, timeout)) return nullptr;
+    do {
+        if (averager != nullptr) averager->add(frame->dB);
+        if (frame->seq <= lastRendered || (newest != nullptr && frame->seq < newest->seq)) {
+            pool.release(frame);
+            continue;
+        }
+        if (newest != nullptr) pool.release(newest);
+        newest = frame;
+    } while (ready.tryPop(frame));
+
+    if (newest != nullptr) {
+        if (averager != nullptr) averager->read(newest->dB);
+        acquired = std::chrono::steady_clock::now();
+        renderQueue.record(newest->dspDone, acquired);
+        lastRendered = newest->seq;
+    }
+    return newest;
+}
+
+void Pipeline::release(SpectrumFrame *frame) {
+    TimePoint now = std::chrono::steady_clock::now();
+    render.record(acquired, now);
+    endToEnd.record(frame->delivered, now);
+    pool.release(frame);
+}
+
+// Keeps an acquired frame alive after the render loop's release(), e.g.
+// for a consumer on another thread, which hands it back with
+// releaseRetained(). Safe from any thread.
+void Pipeline::retain(SpectrumFrame *frame) {
+    pool.retain(frame);
+}
+
+void Pipeline::releaseRetained(SpectrumFrame *frame) {
+    pool.release(frame);
+}
+
+uint64_t Pipeline::getDropped() const {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+// One line per stage, recorder counters last. Shared by printStats, the
+// stats overlay and the periodic stats log.
+void Pipeline::writeStats(std::ostream &out) const {
+    recorder.callback.write(out, "callback");
+    recorder.adcLatency.write(out, "adc latency");
+    capture.write(out, "capture");
+    dspQueue.write(out, "dsp queue");
+    dsp.write(out, "dsp");
+    fft.write(out, "fft");
+    renderQueue.write(out, "render queue");
+    render.write(out, "render");
+    endToEnd.write(out, "end to end");
+    out << std::setw(14) << "dropped" << ": " << getDropped() << " windows, "
+        << recorder.getOverruns() << " samples overrun, " << recorder.getTapDropped()
+        << " frames not recorded" << std::endl;
+    out << std::setw(14) << "input" << ": " << recorder.getInputOverflows() << " overflows, "
+        << recorder.getInputUnderflows() << " underflows, " << recorder.getEmptyReads()
+        << " empty reads" << std::endl;
+    out << std::setw(14) << "frame memory" << ": " << arena.getUsed()/1024 << " KB used of "
+        << arena.getReserved()/1024 << " KB, " << arena.getHugeChunks() << " huge page chunks" << std::endl;
+    if (averager != nullptr && averager->getMode() == AverageMode::Percentile) {
+        out << std::setw(14) << "noise floor" << ": P50 " << averager->floorDB(0.5f) << " dB, P95 "
+            << averager->floorDB(0.95f) << " dB over " << averager->getFrames() << " frames" << std::endl;
+    }
+}
+
+void Pipeline::printStats() const {
+    writeStats(std::cout);
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef PLAN_REGISTRY_H
+#define PLAN_REGISTRY_H
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+#include <fftw3.h>
+
+#define FFTW_WISDOM_FILE    "iir-test.wisdom"
+#define FFTW_PLAN_FLAGS     FFTW_MEASURE
+
+enum class FFTDirection {
+    R2C,
+    C2R
+};
+
+// Owns every FFTW plan in the process. Plans are measured once per
+// (size, direction, alignment) and reused through the new-array execute
+// functions. Wisdom is loaded on construction and saved on destruction so
+// FFTW_MEASURE only costs time the first time a size is seen.
+class PlanRegistry {
+    public:
+        PlanRegistry(const std::string &wisdomFile = FFTW_WISDOM_FILE);
+        PlanRegistry(const PlanRegistry&) = delete;
+        PlanRegistry& operator=(const PlanRegistry&) = delete;
+        ~PlanRegistry();
+
+        fftwf_plan get(uint32_t size, FFTDirection direction, bool aligned = true);
+        fftwf_plan r2c(uint32_t size, bool aligned = true);
+        fftwf_plan c2r(uint32_t size, bool aligned = true);
+        static bool isAligned(const void *in, const void *out);
+
+        void prewarm(const std::vector<uint32_t> &sizes);
+        void waitPrewarm();
+        bool saveWisdom();
+    private:
+        typedef std::tuple<uint32_t, FFTDirection, bool> Key;
+
+        fftwf_plan create(uint32_t size, FFTDirection direction, bool aligned);
+
+        std::string wisdomFile;
+        std::map<Key, fftwf_plan> plans;
+        std::mutex mutex;   // FFTW's planner is not thread safe
+        std::thread prewarmThread;
+        std::atomic<bool> cancelPrewarm{false};
+        bool dirty = false; // new plans since wisdom was loaded
+};
+
+PlanRegistry::PlanRegistry(const std::string &_wisdomFile)
+    : wisdomFile(_wisdomFile)
+{
+    if (!wisdomFile.empty() && fftwf_import_wisdom_from_filename(wisdomFile.c_str())) {
+        std::cout << "Loaded FFTW wisdom from \'" << wisdomFile << "\'" << std::endl;
+    }
+}
+
+PlanRegistry::~PlanRegistry() {
+    cancelPrewarm = true;
+    waitPrewarm();
+    if (dirty) saveWisdom();
+    for (auto &entry : plans) fftwf_destroy_plan(entry.second);
+}
+
+fftwf_plan PlanRegistry::get(uint32_t size, FFTDirection direction, bool aligned) {
+    std::lock_guard<std::mutex> lock(mutex);
+    Key key(size, direction, aligned);
+    auto it = plans.find(key);
+    if (it != plans.end()) return it->second;
+
+    fftwf_plan plan = create(size, direction, aligned);
+    plans[key] = plan;
+    return plan;
+}
+
+fftwf_plan PlanRegistry::r2c(uint32_t size, bool aligned) {
+    return get(size, FFTDirection::R2C, aligned);
+}
+
+fftwf_plan PlanRegistry::c2r(uint32_t size, bool aligned) {
+    return get(size, FFTDirection::C2R, aligned);
+}
+
+// Aligned plans may only be executed on arrays with fftwf_malloc alignment
+bool PlanRegistry::isAligned(const void *in, const void *out) {
+    return fftwf_alignment_of((float*) in) == 0 && fftwf_alignment_of((float*) out) == 0;
+}
+
+// Called with `mutex` held
+fftwf_plan PlanRegistry::create(uint32_t size, FFTDirection direction, bool aligned) {
+    // Scratch arrays: planning overwrites them and they are never executed on
+    float *real = (float*) fftwf_malloc(sizeof(float) * size);
+    fftwf_complex *complex = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * (size/2 + 1));
+    unsigned flags = FFTW_PLAN_FLAGS | (aligned ? 0 : FFTW_UNALIGNED);
+
+    // Plan from wisdom alone first to learn whether measuring will be needed
+    fftwf_plan plan = direction == FFTDirection::R2C
+        ? fftwf_plan_dft_r2c_1d(size, real, complex, flags | FFTW_WISDOM_ONLY)
+        : fftwf_plan_dft_c2r_1d(size, complex, real, flags | FFTW_WISDOM_ONLY);
+    if (plan == nullptr) {
+        plan = direction == FFTDirection::R2C
+            ? fftwf_plan_dft_r2c_1d(size, real, complex, flags)
+            : fftwf_plan_dft_c2r_1d(size, complex, real, flags);
+        dirty = true;
+    }
+
+    fftwf_free(complex);
+    fftwf_free(real);
+    return plan;
+}
+
+// Measures the given sizes on a background thread
+void PlanRegistry::prewarm(const std::vector<uint32_t> &sizes) {
+    waitPrewarm();
+    cancelPrewarm = false;
+    prewarmThread = std::thread([this, sizes]() {
+        for (uint32_t size : sizes) {
+            if (cancelPrewarm) break;
+            r2c(size);
+        }
+    });
+}
+
+void PlanRegistry::waitPrewarm() {
+    if (prewarmThread.joinable()) prewarmThread.join();
+}
+
+bool PlanRegistry::saveWisdom() {
+    if (wisdomFile.empty()) return false;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!fftwf_export_wisdom_to_filename(wisdomFile.c_str())) {
+        std::cout << "Failed to write FFTW wisdom to \'" << wisdomFile << "\'" << std::endl;
+        return false;
+    }
+    dirty = false;
+    return true;
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef Q15_H
+#define Q15_H
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// int16 samples as Q15 fractions of full scale, the format of paInt16
+// streams and 16-bit PCM WAV files. Converting costs one multiply per
+// sample, 16 (8 without AVX2) at a time.
+
+#define Q15_SCALE   32768.0f
+
+void q15ToFloat(const int16_t *in, float *out, uint32_t n) {
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    const __m256 vScale = _mm256_set1_ps(1.0f/Q15_SCALE);
+    for (; i + 16 <= n; i += 16) {
+        __m256i x = _mm256_loadu_si256((const __m256i*) &in[i]);
+        __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(x));
+        __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(x, 1));
+        _mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_cvtepi32_ps(lo), vScale));
+        _mm256_storeu_ps(&out[i + 8], _mm256_mul_ps(_mm256_cvtepi32_ps(hi), vScale));
+    }
+#elif defined(__SSE2__)
+    const __m128 vScale = _mm_set1_ps(1.0f/Q15_SCALE);
+    for (; i + 8 <= n; i += 8) {
+        __m128i x = _mm_loadu_si128((const __m128i*) &in[i]);
+        // Sign extend by unpacking into the high halves and shifting back
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16);
+        _mm_storeu_ps(&out[i], _mm_mul_ps(_mm_cvtepi32_ps(lo), vScale));
+        _mm_storeu_ps(&out[i + 4], _mm_mul_ps(_mm_cvtepi32_ps(hi), vScale));
+    }
+#endif
+    for (; i < n; i++) out[i] = in[i] * (1.0f/Q15_SCALE);
+}
+
+// Rounds to nearest and saturates, so over-range input clips instead of
+// wrapping
+void floatToQ15(const float *in, int16_t *out, uint32_t n) {
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    const __m256 vScale = _mm256_set1_ps(Q15_SCALE);
+    const __m256 vMin = _mm256_set1_ps(-Q15_SCALE), vMax = _mm256_set1_ps(Q15_SCALE - 1);
+    for (; i + 16 <= n; i += 16) {
+        // Clamped first, far out of range floats would convert to INT32_MIN
+        __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&in[i]), vScale), vMin), vMax);
+        __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(&in[i + 8]), vScale), vMin), vMax);
+        __m256i lo = _mm256_cvtps_epi32(a);
+        __m256i hi = _mm256_cvtps_epi32(b);
+        // packs works within 128 bit lanes, the permute puts them back in order
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*) &out[i], packed);
+    }
+#elif defined(__SSE2__)
+    const __m128 vScale = _mm_set1_ps(Q15_SCALE);
+    const __m128 vMin = _mm_set1_ps(-Q15_SCALE), vMax = _mm_set1_ps(Q15_SCALE - 1);
+    for (; i + 8 <= n; i += 8) {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&in[i]), vScale), vMin), vMax);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(&in[i + 4]), vScale), vMin), vMax);
+        __m128i lo = _mm_cvtps_epi32(a);
+        __m128i hi = _mm_cvtps_epi32(b);
+        _mm_storeu_si128((__m128i*) &out[i], _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for (; i < n; i++) {
+        float x = std::fmin(std::fmax(in[i] * Q15_SCALE, -Q15_SCALE), Q15_SCALE - 1);
+        out[i] = (int16_t) std::nearbyint(x);
+    }
+}
+
+#endif
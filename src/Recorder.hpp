@@ -1,120 +1,434 @@
 #ifndef RECORDER_H
 #define RECORDER_H
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cstdint>
-#include "CircularBuffer.hpp"
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "Deinterleave.hpp"
+#include "Notifier.hpp"
+#include "Q15.hpp"
+#include "SampleSource.hpp"
+#include "SPSCBuffer.hpp"
+#include "Stats.hpp"
 #include "portaudio.h"
 
-#define SAMPLE_RATE         16000
+#define SAMPLE_RATE         16000   // analysis rate; capture may run faster and be decimated
 #define FRAMES_PER_BUFFER   512
 #define NUM_CHANNELS        1
+#define DEINTERLEAVE_FRAMES 64      // frames split per pass in the callback
+#define CONVERT_FRAMES      256     // int16 samples converted to float per pass on read
 
-class Recorder {
+// Where a stream stood on the shared clock: frame `frame` of the stream
+// (counted from start, paused or not) reached the ADC at `adc`
+struct CaptureStamp {
+    uint64_t frame;
+    TimePoint adc;
+};
+
+// One input stream, from a PortAudio device unless another SampleSource
+// is set. Each channel gets its own planar ring, so per-channel consumers
+// (one Pipeline or filter thread each) read without sharing anything but
+// the data-ready notifier. Delivery splits interleaved input with a SIMD
+// transpose. Several recorders can run at once; their CaptureStamps are all
+// on steady_clock, which lets streams from different devices be lined up
+// (see CaptureGroup).
+// With SampleFormat::Int16 the stream, rings and tap all hold Q15 samples,
+// half the memory, and readBlock/readStream convert to float in SIMD blocks
+// as the analysis pulls them out.
+class Recorder : private SampleSink {
     public:
-        Recorder(uint32_t fftSize);
+        Recorder(uint32_t fftSize, uint32_t numChannels = NUM_CHANNELS, PaDeviceIndex device = paNoDevice,
+                 uint32_t sampleRate = SAMPLE_RATE, uint32_t framesPerBuffer = FRAMES_PER_BUFFER,
+                 SampleFormat format = SampleFormat::Float32);
+        Recorder(const Recorder&) = delete;
+        Recorder& operator=(const Recorder&) = delete;
         ~Recorder();
 
+        void setSource(std::unique_ptr<SampleSource> _source);
         bool start();
         void stop();
-        int readBlock(float* outputBuffer, uint32_t framesToRead);
+        int readBlock(float* outputBuffer, uint32_t framesToRead, uint32_t channel = 0);
+        int readStream(float* outputBuffer, uint32_t maxFrames, uint32_t channel = 0);
+        bool addReader(uint32_t channel);
+        bool enableTap(uint32_t frames);
+        int readTap(void *outputBuffer, uint32_t maxFrames);
+        uint64_t getTapDropped() const;
+        uint32_t getNumChannels() const;
+        uint32_t getSampleRate() const;
+        SampleFormat getFormat() const;
+        CaptureStamp lastStamp() const;
+        int64_t frameAt(TimePoint when) const;
+        uint64_t getOverruns() const;
+        uint64_t getInputOverflows() const;
+        uint64_t getInputUnderflows() const;
+        uint64_t getEmptyReads() const;
+        TimePoint lastCallback() const;
+        Notifier& dataNotifier();
+
+        static void listDevices();
+        static PaDeviceIndex findDevice(const char *name);
+
+        StageLatency callback;      // time spent inside the audio callback
+        StageLatency adcLatency;    // ADC capture -> callback, as reported by the source
     private:
-        PaStream *stream;
-        PaStreamParameters inputParameters;
+        // Per-channel rings, delivery scratch and tap for one sample type;
+        // only the set matching `format` is used
+        template <typename T>
+        struct Rings {
+            std::vector<std::unique_ptr<SPSCBuffer<T>>> bufs;   // one per channel
+            std::vector<T> planar;                              // DEINTERLEAVE_FRAMES per channel
+            std::vector<T*> planes;
+            std::unique_ptr<SPSCBuffer<T>> tap;                 // interleaved copy for a second consumer
+        };
+
+        void deliver(const void *interleaved, uint32_t frames, TimePoint adc, PaStreamCallbackFlags flags) override;
+        uint32_t space() override;
+        template <typename T> void allocate(Rings<T> &rings, uint32_t capacity);
+        template <typename T> void store(Rings<T> &rings, const T *interleaved, uint32_t frames);
+        template <typename T> uint32_t ringSpace(Rings<T> &rings);
+        static uint32_t readQ15(SPSCBuffer<int16_t> &buf, float *outputBuffer, uint32_t n);
+        void publishStamp(uint64_t frame, TimePoint adc);
+
+        std::unique_ptr<SampleSource> source;
+        bool started = false;
         uint32_t fftSize;
-        CircularBuffer<float> buf;
+        uint32_t numChannels;
+        PaDeviceIndex device;
+        uint32_t sampleRate;    // 0 until start() when the device default is wanted
+        uint32_t framesPerBuffer;
+        SampleFormat format;
+        Rings<float> rings;
+        Rings<int16_t> rings16;
+        std::atomic<uint64_t> tapDropped{0};                    // frames
+        std::vector<bool> readers;                              // channels someone drains, see addReader()
+        uint64_t framesDelivered = 0;                           // source thread only
         std::atomic<bool> paused{false};
-        std::atomic<bool> dataReady{false};
-
-        static int pAudioCallback(const void *inputBuffer, void *outputBuffer,
-                                  uint64_t framesPerBuffer,
-                                  const PaStreamCallbackTimeInfo *timeInfo,
-                                  PaStreamCallbackFlags statusFlags,
-                                  void *userData);
+        Notifier dataReady;
+        std::atomic<uint64_t> inputOverflows{0};
+        std::atomic<uint64_t> inputUnderflows{0};
+        std::atomic<uint64_t> emptyReads{0};
+        std::atomic<int64_t> lastCallbackNs{0};
+        std::atomic<uint32_t> stampSeq{0};  // odd while a stamp is being written
+        std::atomic<uint64_t> stampFrame{0};
+        std::atomic<int64_t> stampNs{0};
 };
 
-Recorder::Recorder(uint32_t _fftSize) 
+// A sampleRate of 0 captures at the source's own rate (the device default
+// for PortAudio), known after start()
+Recorder::Recorder(uint32_t _fftSize, uint32_t _numChannels, PaDeviceIndex _device, uint32_t _sampleRate,
+                   uint32_t _framesPerBuffer, SampleFormat _format)
     : fftSize(_fftSize),
-      buf(_fftSize)
-{ }
+      numChannels(_numChannels == 0 ? 1 : _numChannels),
+      device(_device),
+      sampleRate(_sampleRate),
+      framesPerBuffer(_framesPerBuffer == 0 ? FRAMES_PER_BUFFER : _framesPerBuffer),
+      format(_format)
+{
+    uint32_t capacity = 4 * (fftSize > framesPerBuffer ? fftSize : framesPerBuffer);
+    if (format == SampleFormat::Int16) allocate(rings16, capacity);
+    else allocate(rings, capacity);
+}
+
+template <typename T>
+void Recorder::allocate(Rings<T> &r, uint32_t capacity) {
+    r.planar.resize(numChannels * DEINTERLEAVE_FRAMES);
+    r.planes.resize(numChannels);
+    for (uint32_t c = 0; c < numChannels; c++) {
+        r.bufs.push_back(std::make_unique<SPSCBuffer<T>>(capacity));
+        r.planes[c] = &r.planar[c * DEINTERLEAVE_FRAMES];
+    }
+}
 
 Recorder::~Recorder() {
     this->stop();
 }
 
+// Replaces the PortAudio default; only while stopped
+void Recorder::setSource(std::unique_ptr<SampleSource> _source) {
+    if (!started) source = std::move(_source);
+}
+
 bool Recorder::start() {
-    PaError err = Pa_Initialize();
-    if (err != paNoError) return false;
-
-    inputParameters.channelCount = NUM_CHANNELS;
-    inputParameters.sampleFormat = paFloat32;
-    inputParameters.device = Pa_GetDefaultInputDevice();
-    inputParameters.suggestedLatency = Pa_GetDeviceInfo(inputParameters.device)->defaultLowInputLatency;
-    inputParameters.hostApiSpecificStreamInfo = NULL;
-    std::cout << "here" << std::endl;
-    if (inputParameters.device == paNoDevice) {
-        fprintf(stderr, "Error: No default input device.\n");
-        return false;
+    if (started) return true;
+    if (!source) source = std::make_unique<PortAudioSource>(device);
+    framesDelivered = 0;
+    started = source->start(this, numChannels, sampleRate, framesPerBuffer, format);
+    return started;
+}
+
+void Recorder::stop() {
+    if (source) source->stop();
+    started = false;
+}
+
+// Reads the most recent `framesToRead` frames of one channel, discarding
+// anything older so the display never lags behind the capture.
+int Recorder::readBlock(float* outputBuffer, uint32_t framesToRead, uint32_t channel) {
+    if (channel >= numChannels) return 0;
+    if (format == SampleFormat::Int16) {
+        SPSCBuffer<int16_t> &buf = *rings16.bufs[channel];
+        uint32_t avail = buf.available();
+        if (avail < framesToRead) {
+            emptyReads.fetch_add(1, std::memory_order_relaxed);
+            return 0;
+        }
+        buf.skip(avail - framesToRead);
+        return readQ15(buf, outputBuffer, framesToRead);
     }
 
+    SPSCBuffer<float> &buf = *rings.bufs[channel];
+    uint32_t avail = buf.available();
+    if (avail < framesToRead) {
+        emptyReads.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
 
-    err = Pa_OpenStream(&stream, &inputParameters,
-                        NULL, SAMPLE_RATE,
-                        FRAMES_PER_BUFFER, paClipOff,
-                        &Recorder::pAudioCallback, this);
+    buf.skip(avail - framesToRead);
+    return buf.read(outputBuffer, framesToRead);
+}
+
+// Consumes up to `maxFrames` frames of one channel in order, for continuous
+// analysis. Each channel may have its own consumer thread.
+int Recorder::readStream(float* outputBuffer, uint32_t maxFrames, uint32_t channel) {
+    if (channel >= numChannels) return 0;
+    int n = format == SampleFormat::Int16 ? readQ15(*rings16.bufs[channel], outputBuffer, maxFrames)
+                                          : rings.bufs[channel]->read(outputBuffer, maxFrames);
+    if (n == 0) emptyReads.fetch_add(1, std::memory_order_relaxed);
+    return n;
+}
 
-    err = Pa_StartStream(stream);
-    if (err != paNoError) return false;
+// Reads through a small stack block so converting needs no allocation
+uint32_t Recorder::readQ15(SPSCBuffer<int16_t> &buf, float *outputBuffer, uint32_t n) {
+    int16_t block[CONVERT_FRAMES];
+    uint32_t total = 0;
+    while (total < n) {
+        uint32_t want = n - total < CONVERT_FRAMES ? n - total : CONVERT_FRAMES;
+        uint32_t got = buf.read(block, want);
+        q15ToFloat(block, &outputBuffer[total], got);
+        total += got;
+        if (got < want) break;
+    }
+    return total;
+}
 
+// Declares that `channel` has a consumer. A source that waits on space()
+// only waits for these channels and the tap, so channels nobody reads
+// just overrun instead of stalling it; with no readers declared every
+// channel counts. Only before start().
+bool Recorder::addReader(uint32_t channel) {
+    if (started || channel >= numChannels) return false;
+    readers.resize(numChannels, false);
+    readers[channel] = true;
     return true;
 }
 
-void Recorder::stop() {
-    if (stream != nullptr) {
-        Pa_StopStream(stream);
-        Pa_CloseStream(stream);
-        stream = nullptr;
+// Keeps an interleaved copy of everything captured in a separate ring of
+// `frames` frames, for a consumer such as CaptureWriter that must see every
+// sample without competing with the analysis readers. Only before start().
+bool Recorder::enableTap(uint32_t frames) {
+    if (started) return false;
+    if (format == SampleFormat::Int16) {
+        if (!rings16.tap) rings16.tap = std::make_unique<SPSCBuffer<int16_t>>(frames * numChannels);
+    } else {
+        if (!rings.tap) rings.tap = std::make_unique<SPSCBuffer<float>>(frames * numChannels);
     }
+    return true;
 }
 
-int Recorder::readBlock(float* outputBuffer, uint32_t framesToRead) {
-    uint32_t currSize = buf.getCurrSize();
-    if (currSize >= framesToRead) {
-        buf.readBlock(outputBuffer, framesToRead);
-        return framesToRead;
+// Consumes up to `maxFrames` whole interleaved frames from the tap, as
+// samples in the Recorder's SampleFormat
+int Recorder::readTap(void *outputBuffer, uint32_t maxFrames) {
+    if (format == SampleFormat::Int16) {
+        if (!rings16.tap) return 0;
+        return rings16.tap->read((int16_t*) outputBuffer, maxFrames * numChannels) / numChannels;
     }
-    return 0;
+    if (!rings.tap) return 0;
+    return rings.tap->read((float*) outputBuffer, maxFrames * numChannels) / numChannels;
 }
 
-int Recorder::pAudioCallback(
-        const void *inputBuffer, void *outputBuffer,
-        unsigned long framesPerBuffer,
-        const PaStreamCallbackTimeInfo *timeInfo,
-        PaStreamCallbackFlags statusFlags,
-        void *userData
-        )
-{
-    Recorder *data = static_cast<Recorder*>(userData);
-    const float *rptr = static_cast<const float*>(inputBuffer);
+// Frames the tap had no room for; the callback drops rather than waits
+uint64_t Recorder::getTapDropped() const {
+    return tapDropped.load(std::memory_order_relaxed);
+}
 
-    (void) outputBuffer; /* Prevent unused variable warnings. */
-    (void) timeInfo;
-    (void) statusFlags;
+uint32_t Recorder::getNumChannels() const {
+    return numChannels;
+}
 
-    unsigned long framesToCalc = data->paused ? 0: framesPerBuffer;
+uint32_t Recorder::getSampleRate() const {
+    return sampleRate;
+}
 
-    if (inputBuffer == NULL) {
-        for (unsigned long i = 0; i < framesToCalc; i++) {
-            data->buf.write(0.0f);
-            if (NUM_CHANNELS == 2) data->buf.write(0.0f);
-        }
+SampleFormat Recorder::getFormat() const {
+    return format;
+}
+
+// Seqlock write; only the callback thread calls this
+void Recorder::publishStamp(uint64_t frame, TimePoint adc) {
+    uint32_t seq = stampSeq.load(std::memory_order_relaxed);
+    stampSeq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    stampFrame.store(frame, std::memory_order_relaxed);
+    stampNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(adc.time_since_epoch()).count(),
+                  std::memory_order_relaxed);
+    stampSeq.store(seq + 2, std::memory_order_release);
+}
+
+// ADC time of the first frame of the newest buffer
+CaptureStamp Recorder::lastStamp() const {
+    CaptureStamp stamp;
+    uint32_t before, after;
+    do {
+        before = stampSeq.load(std::memory_order_acquire);
+        stamp.frame = stampFrame.load(std::memory_order_relaxed);
+        stamp.adc = TimePoint(std::chrono::duration_cast<TimePoint::duration>(
+            std::chrono::nanoseconds(stampNs.load(std::memory_order_relaxed))));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = stampSeq.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    return stamp;
+}
+
+// Stream frame that was (or will be) at the ADC at `when`, extrapolated
+// from the newest stamp at the nominal sample rate
+int64_t Recorder::frameAt(TimePoint when) const {
+    CaptureStamp stamp = lastStamp();
+    int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(when - stamp.adc).count();
+    return (int64_t) stamp.frame + ns * sampleRate / 1000000000LL;
+}
+
+// Samples dropped because a consumer fell behind, summed over the
+// channels that have one
+uint64_t Recorder::getOverruns() const {
+    uint64_t total = 0;
+    for (uint32_t c = 0; c < numChannels; c++) {
+        if (!readers.empty() && !readers[c]) continue;
+        if (c < rings.bufs.size()) total += rings.bufs[c]->getOverruns();
+        if (c < rings16.bufs.size()) total += rings16.bufs[c]->getOverruns();
+    }
+    return total;
+}
+
+// Callbacks where PortAudio reported lost input (overflow) or had to
+// insert silence (underflow)
+uint64_t Recorder::getInputOverflows() const {
+    return inputOverflows.load(std::memory_order_relaxed);
+}
+
+uint64_t Recorder::getInputUnderflows() const {
+    return inputUnderflows.load(std::memory_order_relaxed);
+}
+
+// readBlock/readStream calls that found nothing to return
+uint64_t Recorder::getEmptyReads() const {
+    return emptyReads.load(std::memory_order_relaxed);
+}
+
+// When the newest samples were handed over, for end-to-end latency
+TimePoint Recorder::lastCallback() const {
+    return TimePoint(std::chrono::duration_cast<TimePoint::duration>(
+        std::chrono::nanoseconds(lastCallbackNs.load(std::memory_order_acquire))));
+}
+
+// Bumped by the source after every buffer, for consumers that want
+// to sleep until data arrives
+Notifier& Recorder::dataNotifier() {
+    return dataReady;
+}
+
+void Recorder::listDevices() {
+    if (Pa_Initialize() != paNoError) return;
+    PaDeviceIndex defaultInput = Pa_GetDefaultInputDevice();
+    for (PaDeviceIndex i = 0; i < Pa_GetDeviceCount(); i++) {
+        const PaDeviceInfo *info = Pa_GetDeviceInfo(i);
+        if (info == NULL || info->maxInputChannels <= 0) continue;
+        std::cout << (i == defaultInput ? '*' : ' ') << std::setw(3) << i << ": " << info->name
+                  << " (" << info->maxInputChannels << " ch, " << info->defaultSampleRate << " Hz)" << std::endl;
+    }
+    Pa_Terminate();
+}
+
+// First input device whose name contains `name`, or paNoDevice
+PaDeviceIndex Recorder::findDevice(const char *name) {
+    if (Pa_Initialize() != paNoError) return paNoDevice;
+    PaDeviceIndex found = paNoDevice;
+    for (PaDeviceIndex i = 0; i < Pa_GetDeviceCount() && found == paNoDevice; i++) {
+        const PaDeviceInfo *info = Pa_GetDeviceInfo(i);
+        if (info != NULL && info->maxInputChannels > 0 && std::strstr(info->name, name) != NULL) found = i;
+    }
+    Pa_Terminate();
+    return found;
+}
+
+// Called by the source for every buffer, on its audio or replay thread
+void Recorder::deliver(const void *interleaved, uint32_t frames, TimePoint adc, PaStreamCallbackFlags flags) {
+    TimePoint entered = std::chrono::steady_clock::now();
+
+    if (flags & paInputOverflow) inputOverflows.fetch_add(1, std::memory_order_relaxed);
+    if (flags & paInputUnderflow) inputUnderflows.fetch_add(1, std::memory_order_relaxed);
+
+    // Without timing info assume the buffer was just filled
+    if (adc == TimePoint()) adc = entered - std::chrono::nanoseconds((int64_t) (1e9 * frames / sampleRate));
+    else adcLatency.record(adc, entered);
+    publishStamp(framesDelivered, adc);
+    framesDelivered += frames;
+
+    uint32_t framesToCalc = paused ? 0 : frames;
+    if (format == SampleFormat::Int16) store(rings16, static_cast<const int16_t*>(interleaved), framesToCalc);
+    else store(rings, static_cast<const float*>(interleaved), framesToCalc);
+
+    lastCallbackNs.store(std::chrono::duration_cast<std::chrono::nanoseconds>(entered.time_since_epoch()).count(),
+                         std::memory_order_release);
+    dataReady.notify();
+    callback.record(entered, std::chrono::steady_clock::now());
+}
+
+template <typename T>
+void Recorder::store(Rings<T> &r, const T *interleaved, uint32_t frames) {
+    uint32_t channels = numChannels;
+
+    if (r.tap) {
+        uint32_t fits = r.tap->space() / channels;
+        uint32_t tapFrames = frames <= fits ? frames : fits;
+        if (tapFrames < frames) tapDropped.fetch_add(frames - tapFrames, std::memory_order_relaxed);
+        if (interleaved == NULL) r.tap->fill(T(0), tapFrames * channels);
+        else r.tap->write(interleaved, tapFrames * channels);
+    }
+
+    if (interleaved == NULL) {
+        for (uint32_t c = 0; c < channels; c++) r.bufs[c]->fill(T(0), frames);
+    } else if (channels == 1) {
+        r.bufs[0]->write(interleaved, frames);
     } else {
-        for (unsigned long i = 0; i < framesToCalc; i++) {
-            data->buf.write(*rptr++);
-            if (NUM_CHANNELS == 2) data->buf.write(*rptr++);
+        for (uint32_t f = 0; f < frames; f += DEINTERLEAVE_FRAMES) {
+            uint32_t n = frames - f < DEINTERLEAVE_FRAMES ? frames - f : DEINTERLEAVE_FRAMES;
+            deinterleave(&interleaved[f * channels], r.planes.data(), channels, n);
+            for (uint32_t c = 0; c < channels; c++) r.bufs[c]->write(r.planes[c], n);
         }
     }
-    return paContinue;
+}
+
+// Frames that fit in every read channel's ring (and the tap, if any), for
+// sources that wait on the consumers instead of keeping real time
+uint32_t Recorder::space() {
+    return format == SampleFormat::Int16 ? ringSpace(rings16) : ringSpace(rings);
+}
+
+template <typename T>
+uint32_t Recorder::ringSpace(Rings<T> &r) {
+    uint32_t frames = UINT32_MAX;
+    for (uint32_t c = 0; c < r.bufs.size(); c++) {
+        if (readers.empty() || readers[c]) frames = std::min(frames, r.bufs[c]->space());
+    }
+    if (r.tap) frames = std::min(frames, r.tap->space() / numChannels);
+    return frames;
 }
 
 #endif
@@ -0,0 +1,273 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "Biquad.hpp"
+#include "STFT.hpp"
+
+#define RESAMPLER_HALF_ZEROS    8       // sinc zero crossings on each side of the prototype
+#define RESAMPLER_KAISER_BETA   8.0f    // ~80 dB stopband
+#define RESAMPLER_ALIGN         8       // phase filters are padded to a multiple of this
+#define RESAMPLE_BLOCK          1024    // input frames per pass through a ResampleChain
+
+// Sum of a[i]*b[i]; n must be a multiple of RESAMPLER_ALIGN
+float dotProduct(const float *a, const float *b, uint32_t n) {
+    uint32_t i = 0;
+    float sum = 0;
+#if defined(__AVX__)
+    __m256 acc0 = _mm256_setzero_ps(), acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+#if defined(__FMA__)
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i]), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(&a[i + 8]), _mm256_loadu_ps(&b[i + 8]), acc1);
+#else
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i])));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(&a[i + 8]), _mm256_loadu_ps(&b[i + 8])));
+#endif
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(&a[i]), _mm256_loadu_ps(&b[i])));
+    }
+    __m256 acc = _mm256_add_ps(acc0, acc1);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    sum = _mm_cvtss_f32(half);
+#elif defined(__SSE__)
+    __m128 acc = _mm_setzero_ps();
+    for (; i + 4 <= n; i += 4) {
+        acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(&a[i]), _mm_loadu_ps(&b[i])));
+    }
+    acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+    acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+    sum = _mm_cvtss_f32(acc);
+#endif
+    for (; i < n; i++) sum += a[i]*b[i];
+    return sum;
+}
+
+// Rational L/M sample rate converter. A Kaiser-windowed sinc designed at
+// the upsampled rate is split into L phase filters, and each output picks
+// the phase it falls on, so only the outputs that are kept get computed:
+// decimating by M costs 1/M of filtering at the input rate. Phase filters
+// are stored reversed and zero padded so each output is one contiguous
+// dot product over the input history.
+class PolyphaseResampler {
+    public:
+        PolyphaseResampler(uint32_t inRate, uint32_t outRate, float bandwidth = 0.9f);
+        PolyphaseResampler(const PolyphaseResampler&) = delete;
+        PolyphaseResampler& operator=(const PolyphaseResampler&) = delete;
+
+        uint32_t process(const float *input, uint32_t n, float *output);
+        uint32_t maxOutput(uint32_t n) const;
+        void reset();
+
+        uint32_t getInterpolation() const;
+        uint32_t getDecimation() const;
+        uint32_t getTapsPerPhase() const;
+    private:
+        uint32_t interpolation, decimation;
+        uint32_t tapsPerPhase;
+        std::vector<float> phases;      // interpolation x tapsPerPhase, reversed
+        std::vector<float> line;        // tapsPerPhase - 1 history samples, then the current block
+        uint32_t position = 0;          // next output's input index within the block
+        uint32_t phase = 0;             // next output's phase
+};
+
+PolyphaseResampler::PolyphaseResampler(uint32_t inRate, uint32_t outRate, float bandwidth) {
+    uint32_t g = std::gcd(inRate, outRate);
+    interpolation = outRate/g;
+    decimation = inRate/g;
+
+    // Cutoff relative to the upsampled rate, below both Nyquist limits
+    uint32_t factor = interpolation > decimation ? interpolation : decimation;
+    double cutoff = 0.5*bandwidth/factor;
+    uint32_t numTaps = 2*RESAMPLER_HALF_ZEROS*factor + 1;
+    tapsPerPhase = (numTaps + interpolation - 1)/interpolation;
+    tapsPerPhase = (tapsPerPhase + RESAMPLER_ALIGN - 1)/RESAMPLER_ALIGN*RESAMPLER_ALIGN;
+
+    std::vector<double> prototype(numTaps);
+    double center = (numTaps - 1)/2.0;
+    double i0Beta = STFT::besselI0(RESAMPLER_KAISER_BETA);
+    for (uint32_t i = 0; i < numTaps; i++) {
+        double t = i - center;
+        double sinc = t == 0 ? 2*cutoff : std::sin(2*M_PI*cutoff*t)/(M_PI*t);
+        double r = t/center;
+        double window = STFT::besselI0(RESAMPLER_KAISER_BETA*std::sqrt(1 - r*r))/i0Beta;
+        prototype[i] = interpolation*sinc*window; // interpolation gain
+    }
+
+    // Phase p holds taps p, p + L, p + 2L, ...; stored newest-last so a
+    // dot product against the history runs forward in memory
+    phases.assign(interpolation*tapsPerPhase, 0);
+    for (uint32_t p = 0; p < interpolation; p++) {
+        float *h = &phases[p*tapsPerPhase];
+        for (uint32_t j = 0; j*interpolation + p < numTaps; j++) {
+            h[tapsPerPhase - 1 - j] = (float) prototype[j*interpolation + p];
+        }
+    }
+    reset();
+}
+
+void PolyphaseResampler::reset() {
+    line.assign(tapsPerPhase - 1, 0);
+    position = 0;
+    phase = 0;
+}
+
+// Upper bound on outputs produced from n more inputs
+uint32_t PolyphaseResampler::maxOutput(uint32_t n) const {
+    return (uint32_t) (((uint64_t) n*interpolation + decimation - 1)/decimation) + 1;
+}
+
+// Consumes all n inputs and writes the outputs they complete, returning
+// how many. `output` must hold maxOutput(n) samples.
+uint32_t PolyphaseResampler::process(const float *input, uint32_t n, float *output) {
+    uint32_t history = tapsPerPhase - 1;
+    line.resize(history + n);
+    std::memcpy(&line[history], input, sizeof(float) * n);
+
+    uint32_t produced = 0;
+    while (position < n) {
+        output[produced++] = dotProduct(&phases[phase*tapsPerPhase], &line[position], tapsPerPhase);
+        phase += decimation;
+        position += phase/interpolation;
+        phase %= interpolation;
+    }
+    position -= n;
+
+    std::memmove(line.data(), &line[n], sizeof(float) * history);
+    line.resize(history);
+    return produced;
+}
+
+uint32_t PolyphaseResampler::getInterpolation() const {
+    return interpolation;
+}
+
+uint32_t PolyphaseResampler::getDecimation() const {
+    return decimation;
+}
+
+uint32_t PolyphaseResampler::getTapsPerPhase() const {
+    return tapsPerPhase;
+}
+
+// Filters and resamplers run in sequence on one channel, e.g. an LPF
+// followed by a 3:1 decimator to zoom into the bottom of a 48 kHz capture.
+// Input is processed in RESAMPLE_BLOCK chunks through two scratch buffers,
+// so nothing is allocated per call once the first block has been seen.
+class ResampleChain {
+    public:
+        ResampleChain(uint32_t _inRate);
+        ResampleChain(const ResampleChain&) = delete;
+        ResampleChain& operator=(const ResampleChain&) = delete;
+
+        void addFilter(const Biquad &filter);
+        void addResampler(uint32_t outRate, float bandwidth = 0.9f);
+        uint32_t process(const float *input, uint32_t n, float *output);
+        uint32_t maxOutput(uint32_t n) const;
+        void reset();
+
+        uint32_t getInputRate() const;
+        uint32_t getOutputRate() const;
+    private:
+        struct Stage {
+            std::unique_ptr<Biquad> filter;
+            std::unique_ptr<PolyphaseResampler> resampler;
+        };
+
+        uint32_t inRate, outRate;
+        std::vector<Stage> stages;
+        std::vector<float> scratchA, scratchB;
+};
+
+ResampleChain::ResampleChain(uint32_t _inRate)
+    : inRate(_inRate),
+      outRate(_inRate)
+{ }
+
+void ResampleChain::addFilter(const Biquad &filter) {
+    Stage stage;
+    stage.filter = std::make_unique<Biquad>(filter);
+    stages.push_back(std::move(stage));
+}
+
+void ResampleChain::addResampler(uint32_t rate, float bandwidth) {
+    Stage stage;
+    stage.resampler = std::make_unique<PolyphaseResampler>(outRate, rate, bandwidth);
+    stages.push_back(std::move(stage));
+    outRate = rate;
+}
+
+uint32_t ResampleChain::maxOutput(uint32_t n) const {
+    for (const Stage &stage : stages) {
+        if (stage.resampler) n = stage.resampler->maxOutput(n);
+    }
+    return n;
+}
+
+// `output` must hold maxOutput(n) samples
+uint32_t ResampleChain::process(const float *input, uint32_t n, float *output) {
+    // Largest intermediate block any stage can produce
+    uint32_t size = RESAMPLE_BLOCK, scratchSize = RESAMPLE_BLOCK;
+    for (const Stage &stage : stages) {
+        if (stage.resampler) size = stage.resampler->maxOutput(size);
+        if (size > scratchSize) scratchSize = size;
+    }
+    if (scratchA.size() < scratchSize) {
+        scratchA.resize(scratchSize);
+        scratchB.resize(scratchSize);
+    }
+
+    uint32_t produced = 0;
+    while (n > 0) {
+        uint32_t take = n < RESAMPLE_BLOCK ? n : RESAMPLE_BLOCK;
+        const float *src = input;
+        uint32_t count = take;
+        float *dst = scratchA.data();
+        for (Stage &stage : stages) {
+            if (stage.filter) {
+                stage.filter->processBlock(src, dst, count);
+            } else {
+                count = stage.resampler->process(src, count, dst);
+            }
+            src = dst;
+            dst = dst == scratchA.data() ? scratchB.data() : scratchA.data();
+        }
+        std::memcpy(&output[produced], src, sizeof(float) * count);
+        produced += count;
+        input += take;
+        n -= take;
+    }
+    return produced;
+}
+
+void ResampleChain::reset() {
+    for (Stage &stage : stages) {
+        if (stage.filter) stage.filter->reset();
+        else stage.resampler->reset();
+    }
+}
+
+uint32_t ResampleChain::getInputRate() const {
+    return inRate;
+}
+
+uint32_t ResampleChain::getOutputRate() const {
+    return outRate;
+}
+
+#endif
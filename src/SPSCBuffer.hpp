@@ -0,0 +1,158 @@
+#ifndef SPSC_BUFFER_H
+#define SPSC_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+// Wait-free single-producer/single-consumer variant of CircularBuffer.
+// The producer (audio callback) only touches `head`, the consumer (UI) only
+// touches `tail`. Indices run freely and are masked into the power-of-two
+// storage, so full/empty never need a separate size counter. Samples that
+// do not fit are dropped and counted instead of overwriting unread data.
+template <typename T>
+class SPSCBuffer {
+    static_assert(std::is_trivially_copyable<T>::value, "SPSCBuffer requires trivially copyable T");
+    public:
+        SPSCBuffer(uint32_t minCapacity);
+        SPSCBuffer(const SPSCBuffer&) = delete;
+        SPSCBuffer& operator=(const SPSCBuffer&) = delete;
+
+        // Producer side
+        uint32_t write(const T *block, uint32_t n);
+        uint32_t fill(T value, uint32_t n);
+        uint32_t space();
+
+        // Consumer side
+        uint32_t read(T *outputBuffer, uint32_t n);
+        uint32_t skip(uint32_t n);
+        uint32_t available() const;
+
+        uint32_t getCapacity() const;
+        uint64_t getOverruns() const;
+    private:
+        static uint32_t nextPowerOfTwo(uint32_t n);
+
+        std::unique_ptr<T[]> data;
+        uint32_t capacity;
+        uint32_t mask;
+
+        alignas(64) std::atomic<uint64_t> head{0};  // write index, owned by producer
+        uint64_t cachedTail = 0;                    // producer's last view of tail
+        alignas(64) std::atomic<uint64_t> tail{0};  // read index, owned by consumer
+        uint64_t cachedHead = 0;                    // consumer's last view of head
+        alignas(64) std::atomic<uint64_t> overruns{0};
+};
+
+template <typename T>
+SPSCBuffer<T>::SPSCBuffer(uint32_t minCapacity) {
+    capacity = nextPowerOfTwo(minCapacity);
+    mask = capacity - 1;
+    data = std::make_unique<T[]>(capacity);
+}
+
+template <typename T>
+uint32_t SPSCBuffer<T>::nextPowerOfTwo(uint32_t n) {
+    uint32_t p = 1;
+    while (p < n) p <<= 1;
+    return p;
+}
+
+template <typename T>
+uint32_t SPSCBuffer<T>::write(const T *block, uint32_t n) {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    uint32_t space = capacity - (uint32_t) (h - cachedTail);
+    if (space < n) {
+        cachedTail = tail.load(std::memory_order_acquire);
+        space = capacity - (uint32_t) (h - cachedTail);
+    }
+
+    uint32_t toWrite = n <= space ? n : space;
+    if (toWrite < n) overruns.fetch_add(n - toWrite, std::memory_order_relaxed);
+    if (toWrite == 0) return 0;
+
+    uint32_t idx = (uint32_t) h & mask;
+    uint32_t first = toWrite <= (capacity - idx) ? toWrite : capacity - idx; // num elements before wrap
+    std::memcpy(&data[idx], block, sizeof(T) * first);
+    if (toWrite > first)
+        std::memcpy(&data[0], &block[first], sizeof(T) * (toWrite - first));
+
+    head.store(h + toWrite, std::memory_order_release);
+    return toWrite;
+}
+
+template <typename T>
+uint32_t SPSCBuffer<T>::fill(T value, uint32_t n) {
+    uint64_t h = head.load(std::memory_order_relaxed);
+    cachedTail = tail.load(std::memory_order_acquire);
+    uint32_t space = capacity - (uint32_t) (h - cachedTail);
+
+    uint32_t toWrite = n <= space ? n : space;
+    if (toWrite < n) overruns.fetch_add(n - toWrite, std::memory_order_relaxed);
+
+    for (uint32_t i = 0; i < toWrite; i++) {
+        data[(h + i) & mask] = value;
+    }
+
+    head.store(h + toWrite, std::memory_order_release);
+    return toWrite;
+}
+
+// Free slots as seen by the producer, for writers that must not split a
+// record (e.g. an interleaved frame) across the drop boundary
+template <typename T>
+uint32_t SPSCBuffer<T>::space() {
+    cachedTail = tail.load(std::memory_order_acquire);
+    return capacity - (uint32_t) (head.load(std::memory_order_relaxed) - cachedTail);
+}
+
+template <typename T>
+uint32_t SPSCBuffer<T>::read(T *outputBuffer, uint32_t n) {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    uint32_t avail = (uint32_t) (cachedHead - t);
+    if (avail < n) {
+        cachedHead = head.load(std::memory_order_acquire);
+        avail = (uint32_t) (cachedHead - t);
+    }
+
+    uint32_t toRead = n <= avail ? n : avail;
+    if (toRead == 0) return 0;
+
+    uint32_t idx = (uint32_t) t & mask;
+    uint32_t first = toRead <= (capacity - idx) ? toRead : capacity - idx;
+    std::memcpy(outputBuffer, &data[idx], sizeof(T) * first);
+    if (toRead > first)
+        std::memcpy(&outputBuffer[first], &data[0], sizeof(T) * (toRead - first));
+
+    tail.store(t + toRead, std::memory_order_release);
+    return toRead;
+}
+
+template <typename T>
+uint32_t SPSCBuffer<T>::skip(uint32_t n) {
+    uint64_t t = tail.load(std::memory_order_relaxed);
+    cachedHead = head.load(std::memory_order_acquire);
+    uint32_t avail = (uint32_t) (cachedHead - t);
+    uint32_t toSkip = n <= avail ? n : avail;
+    tail.store(t + toSkip, std::memory_order_release);
+    return toSkip;
+}
+
+template <typename T>
+uint32_t SPSCBuffer<T>::available() const {
+    return (uint32_t) (head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed));
+}
+
+template <typename T>
+uint32_t SPSCBuffer<T>::getCapacity() const {
+    return capacity;
+}
+
+template <typename T>
+uint64_t SPSCBuffer<T>::getOverruns() const {
+    return overruns.load(std::memory_order_relaxed);
+}
+
+#endif
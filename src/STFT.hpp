@@ -0,0 +1,242 @@
+#ifndef STFT_H
+#define STFT_H
+
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <fftw3.h>
+
+#include "CircularBuffer.hpp"
+#include "PlanRegistry.hpp"
+#include "Span.hpp"
+
+enum class WindowType {
+    Rectangular,
+    Hann,
+    Blackman,
+    Kaiser
+};
+
+bool parseWindow(const char *name, WindowType &windowType) {
+    if (strcmp(name, "hann") == 0) windowType = WindowType::Hann;
+    else if (strcmp(name, "blackman") == 0) windowType = WindowType::Blackman;
+    else if (strcmp(name, "kaiser") == 0) windowType = WindowType::Kaiser;
+    else if (strcmp(name, "rect") == 0) windowType = WindowType::Rectangular;
+    else return false;
+    return true;
+}
+
+// output[i] = input[i]*window[i]. A nonzero FixedSize makes the trip count
+// a compile-time constant so the loop is vectorized without a remainder.
+template <uint32_t FixedSize>
+void applyWindowN(const float *__restrict input, const float *__restrict window, float *__restrict output, uint32_t size) {
+    const uint32_t n = FixedSize != 0 ? FixedSize : size;
+    for (uint32_t i = 0; i < n; i++) output[i] = input[i]*window[i];
+}
+
+// Power-of-two FFT sizes in common use get their own instantiation
+void applyWindow(const float *input, const float *window, float *output, uint32_t n) {
+    switch (n) {
+        case 256:  applyWindowN<256>(input, window, output, n); break;
+        case 512:  applyWindowN<512>(input, window, output, n); break;
+        case 1024: applyWindowN<1024>(input, window, output, n); break;
+        case 2048: applyWindowN<2048>(input, window, output, n); break;
+        case 4096: applyWindowN<4096>(input, window, output, n); break;
+        case 8192: applyWindowN<8192>(input, window, output, n); break;
+        default:   applyWindowN<0>(input, window, output, n); break;
+    }
+}
+
+// Streaming short-time Fourier transform. Samples are pushed in arbitrary
+// chunks; every `hopSize` new samples a windowed frame is transformed into
+// the next of `numSlots` preallocated spectra. Nothing is allocated after
+// construction; the plan is shared through the PlanRegistry.
+class STFT {
+    public:
+        STFT(PlanRegistry &plans, uint32_t fftSize, uint32_t hopSize, WindowType windowType = WindowType::Hann,
+             uint32_t numSlots = 8, float kaiserBeta = 8.6f);
+        STFT(const STFT&) = delete;
+        STFT& operator=(const STFT&) = delete;
+        ~STFT();
+
+        uint32_t push(const float *samples, uint32_t n);
+        void analyze(const float *frame);
+        void analyze(SpanPair<const float> frame);
+        void reset();
+
+        fftwf_complex* latestFrame() const;
+        fftwf_complex* frame(uint32_t age) const;
+        uint32_t getFFTSize() const;
+        uint32_t getHopSize() const;
+        uint32_t getNumBins() const;
+        uint64_t getFramesProduced() const;
+
+        static void computeWindow(WindowType windowType, float kaiserBeta, float *output, uint32_t n);
+        static double besselI0(double x);
+    private:
+        void transform(SpanPair<const float> frame);
+
+        uint32_t fftSize, hopSize, numBins, numSlots;
+        float *window;
+        CircularBuffer<float> history;  // last fftSize input samples
+        uint32_t untilNext;             // samples still needed for the next frame
+        float *fftIn;
+        fftwf_complex **slots;
+        uint32_t nextSlot = 0;
+        uint64_t framesProduced = 0;
+        fftwf_plan plan;
+};
+
+STFT::STFT(PlanRegistry &plans, uint32_t _fftSize, uint32_t _hopSize, WindowType windowType,
+           uint32_t _numSlots, float kaiserBeta)
+    : fftSize(_fftSize),
+      hopSize(_hopSize == 0 || _hopSize > _fftSize ? _fftSize : _hopSize),
+      numBins(_fftSize/2 + 1),
+      numSlots(_numSlots == 0 ? 1 : _numSlots),
+      history(_fftSize)
+{
+    window = (float*) fftwf_malloc(sizeof(float) * fftSize);
+    fftIn = (float*) fftwf_malloc(sizeof(float) * fftSize);
+    slots = new fftwf_complex*[numSlots];
+    for (uint32_t i = 0; i < numSlots; i++) {
+        slots[i] = (fftwf_complex*) fftwf_malloc(sizeof(fftwf_complex) * numBins);
+    }
+    plan = plans.r2c(fftSize);
+
+    computeWindow(windowType, kaiserBeta, window, fftSize);
+    reset();
+}
+
+STFT::~STFT() {
+    for (uint32_t i = 0; i < numSlots; i++) fftwf_free(slots[i]);
+    delete[] slots;
+    fftwf_free(fftIn);
+    fftwf_free(window);
+}
+
+double STFT::besselI0(double x) {
+    // Power series, converges quickly for the beta values used in windows
+    double sum = 1, term = 1;
+    for (uint32_t k = 1; k < 50; k++) {
+        term *= (x/(2*k))*(x/(2*k));
+        sum += term;
+        if (term < sum*1e-12) break;
+    }
+    return sum;
+}
+
+void STFT::computeWindow(WindowType windowType, float kaiserBeta, float *output, uint32_t n) {
+    // Periodic windows, as wanted for overlapped analysis
+    double sum = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        double phase = 2*M_PI*i/n;
+        double w;
+        switch (windowType) {
+            case WindowType::Hann:
+                w = 0.5 - 0.5*cos(phase);
+                break;
+            case WindowType::Blackman:
+                w = 0.42 - 0.5*cos(phase) + 0.08*cos(2*phase);
+                break;
+            case WindowType::Kaiser: {
+                double r = 2.0*i/n - 1;
+                w = besselI0(kaiserBeta*sqrt(1 - r*r))/besselI0(kaiserBeta);
+                break;
+            }
+            case WindowType::Rectangular:
+            default:
+                w = 1;
+                break;
+        }
+        output[i] = w;
+        sum += w;
+    }
+
+    // Normalize coherent gain so a full-scale tone still reads 0 dB
+    float scale = n/sum;
+    for (uint32_t i = 0; i < n; i++) output[i] *= scale;
+}
+
+// Windowing reads the (possibly wrapped) frame in place, so samples go
+// from the history ring to the FFT input in a single pass
+void STFT::transform(SpanPair<const float> frame) {
+    uint32_t split = (uint32_t) frame.first.size();
+    if (split == fftSize) {
+        applyWindow(frame.first.data(), window, fftIn, fftSize);
+    } else {
+        applyWindowN<0>(frame.first.data(), window, fftIn, split);
+        applyWindowN<0>(frame.second.data(), &window[split], &fftIn[split], fftSize - split);
+    }
+    fftwf_execute_dft_r2c(plan, fftIn, slots[nextSlot]);
+    nextSlot = (nextSlot + 1) % numSlots;
+    framesProduced++;
+}
+
+// Returns the number of frames completed by these samples
+uint32_t STFT::push(const float *samples, uint32_t n) {
+    uint32_t produced = 0;
+    while (n > 0) {
+        uint32_t take = n <= untilNext ? n : untilNext;
+        history.write(Span<const float>(samples, take));
+        untilNext -= take;
+        samples += take;
+        n -= take;
+
+        if (untilNext == 0) {
+            transform(history.peekLatest(fftSize));
+            produced++;
+            untilNext = hopSize;
+        }
+    }
+    return produced;
+}
+
+// One-shot transform of fftSize contiguous samples, bypassing the history
+void STFT::analyze(const float *frame) {
+    transform({Span<const float>(frame, fftSize), Span<const float>()});
+}
+
+// Same, for a frame that wraps around a ring buffer. Frames that are not
+// exactly fftSize samples long are ignored.
+void STFT::analyze(SpanPair<const float> frame) {
+    if (frame.size() != fftSize) return;
+    transform(frame);
+}
+
+void STFT::reset() {
+    history.clear();
+    untilNext = fftSize;
+    nextSlot = 0;
+    framesProduced = 0;
+    for (uint32_t i = 0; i < numSlots; i++) {
+        std::memset(slots[i], 0, sizeof(fftwf_complex) * numBins);
+    }
+}
+
+fftwf_complex* STFT::latestFrame() const {
+    return frame(0);
+}
+
+// age 0 is the newest frame, numSlots - 1 the oldest still held
+fftwf_complex* STFT::frame(uint32_t age) const {
+    uint32_t idx = (nextSlot + numSlots - 1 - (age % numSlots)) % numSlots;
+    return slots[idx];
+}
+
+uint32_t STFT::getFFTSize() const {
+    return fftSize;
+}
+
+uint32_t STFT::getHopSize() const {
+    return hopSize;
+}
+
+uint32_t STFT::getNumBins() const {
+    return numBins;
+}
+
+uint64_t STFT::getFramesProduced() const {
+    return framesProduced;
+}
+
+#endif
@@ -0,0 +1,286 @@
+#ifndef SAMPLE_FILE_H
+#define SAMPLE_FILE_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Q15.hpp"
+
+#define WAV_FORMAT_PCM          1
+#define WAV_FORMAT_FLOAT        3
+#define WAV_FORMAT_EXTENSIBLE   0xFFFE
+#define WAV_HEADER_BYTES        44
+
+// How samples are stored in capture rings and files. Int16 is Q15, half
+// the memory and disk bandwidth of Float32.
+enum class SampleFormat {
+    Float32,
+    Int16
+};
+
+bool parseSampleFormat(const char *name, SampleFormat &format) {
+    if (strcasecmp(name, "float") == 0 || strcasecmp(name, "float32") == 0) format = SampleFormat::Float32;
+    else if (strcasecmp(name, "int16") == 0) format = SampleFormat::Int16;
+    else return false;
+    return true;
+}
+
+uint32_t sampleBytes(SampleFormat format) {
+    return format == SampleFormat::Int16 ? sizeof(int16_t) : sizeof(float);
+}
+
+// Canonical 44 byte header for float32 or 16-bit PCM WAV data of
+// `dataBytes` bytes, the layouts SampleFile reads back
+void makeWavHeader(uint8_t *header, uint32_t channels, uint32_t sampleRate, uint32_t dataBytes,
+                   SampleFormat sampleFormat = SampleFormat::Float32) {
+    uint16_t bits = 8 * sampleBytes(sampleFormat);
+    uint16_t format = sampleFormat == SampleFormat::Int16 ? WAV_FORMAT_PCM : WAV_FORMAT_FLOAT;
+    uint16_t numChannels = channels, blockAlign = bits/8 * channels;
+    uint32_t riffSize = dataBytes + WAV_HEADER_BYTES - 8, fmtSize = 16, byteRate = sampleRate * blockAlign;
+    std::memcpy(header, "RIFF", 4);
+    std::memcpy(header + 4, &riffSize, 4);
+    std::memcpy(header + 8, "WAVEfmt ", 8);
+    std::memcpy(header + 16, &fmtSize, 4);
+    std::memcpy(header + 20, &format, 2);
+    std::memcpy(header + 22, &numChannels, 2);
+    std::memcpy(header + 24, &sampleRate, 4);
+    std::memcpy(header + 28, &byteRate, 4);
+    std::memcpy(header + 32, &blockAlign, 2);
+    std::memcpy(header + 34, &bits, 2);
+    std::memcpy(header + 36, "data", 4);
+    std::memcpy(header + 40, &dataBytes, 4);
+}
+
+// Read-only, memory-mapped capture. Accepts headerless raw float32 files
+// (as written by audio.cpp) and IEEE float or 16-bit PCM WAV files. Float
+// frames are handed out as views straight into the mapping, so only pages
+// that are actually looked at become resident. 16-bit files stay mapped as
+// they are and each range is converted to float as it is asked for.
+class SampleFile {
+    public:
+        SampleFile() = default;
+        SampleFile(const SampleFile&) = delete;
+        SampleFile& operator=(const SampleFile&) = delete;
+        ~SampleFile();
+
+        bool open(const char *filename, uint32_t rawChannels = 1, uint32_t rawSampleRate = 0);
+        void close();
+        bool isOpen() const;
+
+        const float* view(uint64_t frame, uint64_t count);
+        const float* read(uint64_t frame, uint64_t count, float *buffer) const;
+        void prefetch(uint64_t frame, uint64_t count) const;
+        void release(uint64_t frame, uint64_t count) const;
+
+        uint64_t getNumFrames() const;
+        uint32_t getChannels() const;
+        uint32_t getSampleRate() const;
+        SampleFormat getFormat() const;
+    private:
+        bool parseWav();
+        void advise(uint64_t frame, uint64_t count, int advice) const;
+
+        uint8_t *map = nullptr;
+        size_t mapSize = 0;
+        const float *samples = nullptr;
+        const int16_t *pcm16 = nullptr;     // data of a 16-bit WAV instead of `samples`
+        std::vector<float> converted;       // view() of a 16-bit file
+        uint64_t numFrames = 0;
+        uint32_t channels = 1;
+        uint32_t sampleRate = 0;
+        uint64_t prefetchBegin = 0; // frames already advised WILLNEED
+        uint64_t prefetchEnd = 0;
+};
+
+SampleFile::~SampleFile() {
+    this->close();
+}
+
+bool SampleFile::open(const char *filename, uint32_t rawChannels, uint32_t rawSampleRate) {
+    close();
+
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) {
+        std::cout << "Failed to open \'" << filename << "\'" << std::endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        std::cout << "Failed to stat \'" << filename << "\'" << std::endl;
+        ::close(fd);
+        return false;
+    }
+
+    mapSize = st.st_size;
+    void *addr = mmap(nullptr, mapSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if (addr == MAP_FAILED) {
+        std::cout << "Failed to map \'" << filename << "\'" << std::endl;
+        mapSize = 0;
+        return false;
+    }
+    map = (uint8_t*) addr;
+    madvise(map, mapSize, MADV_SEQUENTIAL);
+
+    if (mapSize >= 12 && std::memcmp(map, "RIFF", 4) == 0 && std::memcmp(map + 8, "WAVE", 4) == 0) {
+        if (!parseWav()) {
+            std::cout << "Unsupported WAV file \'" << filename << "\' (need 32-bit float or 16-bit PCM)" << std::endl;
+            close();
+            return false;
+        }
+    } else {
+        channels = rawChannels == 0 ? 1 : rawChannels;
+        sampleRate = rawSampleRate;
+        samples = (const float*) map;
+        numFrames = mapSize / (sizeof(float) * channels);
+    }
+
+    std::cout << "Mapped " << numFrames << " frames from \'" << filename << "\'" << std::endl;
+    return true;
+}
+
+bool SampleFile::parseWav() {
+    uint64_t pos = 12;
+    uint16_t format = 0, bits = 0;
+    bool haveFormat = false;
+
+    while (pos + 8 <= mapSize) {
+        const uint8_t *chunk = map + pos;
+        uint32_t chunkSize;
+        std::memcpy(&chunkSize, chunk + 4, 4);
+        uint64_t body = pos + 8;
+
+        if (std::memcmp(chunk, "fmt ", 4) == 0 && chunkSize >= 16 && body + 16 <= mapSize) {
+            uint16_t numChannels;
+            std::memcpy(&format, map + body, 2);
+            std::memcpy(&numChannels, map + body + 2, 2);
+            std::memcpy(&sampleRate, map + body + 4, 4);
+            std::memcpy(&bits, map + body + 14, 2);
+            if (format == WAV_FORMAT_EXTENSIBLE && chunkSize >= 26 && body + 26 <= mapSize) {
+                std::memcpy(&format, map + body + 24, 2); // first two bytes of the subformat GUID
+            }
+            channels = numChannels;
+            haveFormat = true;
+        } else if (std::memcmp(chunk, "data", 4) == 0) {
+            if (!haveFormat || channels == 0) return false;
+            uint64_t dataSize = chunkSize <= mapSize - body ? chunkSize : mapSize - body;
+            if (format == WAV_FORMAT_PCM && bits == 16) {
+                if (body % sizeof(int16_t) != 0) return false;
+                pcm16 = (const int16_t*) (map + body);
+                numFrames = dataSize / (sizeof(int16_t) * channels);
+                return true;
+            }
+            if (format != WAV_FORMAT_FLOAT || bits != 32) return false;
+            if (body % sizeof(float) != 0) return false; // views must be float aligned
+            samples = (const float*) (map + body);
+            numFrames = dataSize / (sizeof(float) * channels);
+            return true;
+        }
+        pos = body + chunkSize + (chunkSize & 1); // chunks are word aligned
+    }
+    return false;
+}
+
+void SampleFile::close() {
+    if (map != nullptr) {
+        munmap(map, mapSize);
+    }
+    map = nullptr;
+    mapSize = 0;
+    samples = nullptr;
+    pcm16 = nullptr;
+    converted.clear();
+    numFrames = 0;
+    channels = 1;
+    sampleRate = 0;
+    prefetchBegin = prefetchEnd = 0;
+}
+
+bool SampleFile::isOpen() const {
+    return map != nullptr;
+}
+
+// `count` interleaved frames starting at `frame`, or nullptr if the range
+// is not inside the file. Zero-copy for float files; 16-bit frames are
+// converted into a buffer that the next call reuses. The next window is
+// prefetched so stepping forward does not fault on every page.
+const float* SampleFile::view(uint64_t frame, uint64_t count) {
+    if (!isOpen() || frame + count > numFrames) return nullptr;
+
+    if (frame < prefetchBegin || frame + count > prefetchEnd) {
+        advise(frame, 2*count, MADV_WILLNEED);
+        prefetchBegin = frame;
+        prefetchEnd = frame + 2*count;
+    }
+    if (pcm16 != nullptr) converted.resize(count * channels);
+    return read(frame, count, converted.data());
+}
+
+// Same as view() without the prefetch bookkeeping, so several threads can
+// read the mapping at once. 16-bit frames are converted into `buffer`,
+// which has to hold count*channels floats; float files leave it untouched.
+const float* SampleFile::read(uint64_t frame, uint64_t count, float *buffer) const {
+    if (!isOpen() || frame + count > numFrames) return nullptr;
+    if (pcm16 == nullptr) return &samples[frame * channels];
+    // q15ToFloat takes a 32 bit count
+    const int16_t *src = &pcm16[frame * channels];
+    for (uint64_t done = 0, total = count * channels; done < total; done += 1u << 30) {
+        uint32_t n = total - done < (1u << 30) ? total - done : 1u << 30;
+        q15ToFloat(&src[done], &buffer[done], n);
+    }
+    return buffer;
+}
+
+void SampleFile::prefetch(uint64_t frame, uint64_t count) const {
+    advise(frame, count, MADV_WILLNEED);
+}
+
+// Drops resident pages of a range the caller no longer needs
+void SampleFile::release(uint64_t frame, uint64_t count) const {
+    advise(frame, count, MADV_DONTNEED);
+}
+
+void SampleFile::advise(uint64_t frame, uint64_t count, int advice) const {
+    if (!isOpen() || frame >= numFrames) return;
+    if (frame + count > numFrames) count = numFrames - frame;
+
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    const size_t frameBytes = sampleBytes(getFormat()) * channels;
+    const uint8_t *data = pcm16 != nullptr ? (const uint8_t*) pcm16 : (const uint8_t*) samples;
+    uintptr_t first = (uintptr_t) &data[frame * frameBytes];
+    uintptr_t begin = first & ~((uintptr_t) pageSize - 1);
+    uintptr_t end = (uintptr_t) &data[(frame + count) * frameBytes];
+    if (advice == MADV_DONTNEED) {
+        // Only whole pages inside the range, neighbours may still be in use
+        begin = (first + pageSize - 1) & ~((uintptr_t) pageSize - 1);
+        end &= ~((uintptr_t) pageSize - 1);
+        if (end <= begin) return;
+    }
+    madvise((void*) begin, end - begin, advice);
+}
+
+uint64_t SampleFile::getNumFrames() const {
+    return numFrames;
+}
+
+uint32_t SampleFile::getChannels() const {
+    return channels;
+}
+
+uint32_t SampleFile::getSampleRate() const {
+    return sampleRate;
+}
+
+// Int16 for 16-bit PCM WAV files, whose samples read() and view() convert
+SampleFormat SampleFile::getFormat() const {
+    return pcm16 != nullptr ? SampleFormat::Int16 : SampleFormat::Float32;
+}
+
+#endif
@@ -0,0 +1,501 @@
+#ifndef SAMPLE_SOURCE_H
+#define SAMPLE_SOURCE_H
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Q15.hpp"
+#include "SampleFile.hpp"
+#include "Stats.hpp"
+#include "portaudio.h"
+
+#define SOURCE_WAIT_US      200     // poll interval while an unpaced source waits for the consumers
+#define GENERATOR_RATE      48000   // a typical device default, so the decimator runs as it would live
+#define RAW_SOURCE_RATE     16000   // headerless captures carry no rate; audio.cpp records at this one
+#define GENERATOR_AMPLITUDE 0.5f
+#define CHIRP_SECONDS       5       // default sweep length before it starts over
+
+// Receives a source's buffers of interleaved frames, on the source's own
+// thread, in the SampleFormat the source was started with. `interleaved`
+// is NULL for silence. `adc` is when the first frame reached the ADC, or a
+// default TimePoint if the source cannot tell.
+class SampleSink {
+    public:
+        virtual ~SampleSink() = default;
+        virtual void deliver(const void *interleaved, uint32_t frames, TimePoint adc, PaStreamCallbackFlags flags) = 0;
+        virtual uint32_t space() = 0;   // frames every consumer can still take without dropping
+};
+
+// Where a Recorder's samples come from. start() settles the sample rate
+// (a rate of 0 asks for the source's own) and then calls deliver() every
+// `framesPerBuffer` frames until stop().
+class SampleSource {
+    public:
+        virtual ~SampleSource() = default;
+        virtual bool start(SampleSink *sink, uint32_t channels, uint32_t &sampleRate, uint32_t framesPerBuffer,
+                           SampleFormat format) = 0;
+        virtual void stop() = 0;
+};
+
+// A live input device
+class PortAudioSource : public SampleSource {
+    public:
+        PortAudioSource(PaDeviceIndex _device = paNoDevice);
+        PortAudioSource(const PortAudioSource&) = delete;
+        PortAudioSource& operator=(const PortAudioSource&) = delete;
+        ~PortAudioSource();
+
+        bool start(SampleSink *_sink, uint32_t channels, uint32_t &_sampleRate, uint32_t framesPerBuffer,
+                   SampleFormat format) override;
+        void stop() override;
+    private:
+        static int pAudioCallback(const void *inputBuffer, void *outputBuffer,
+                                  unsigned long framesPerBuffer,
+                                  const PaStreamCallbackTimeInfo *timeInfo,
+                                  PaStreamCallbackFlags statusFlags,
+                                  void *userData);
+
+        PaDeviceIndex device;
+        PaStream *stream = nullptr;
+        SampleSink *sink = nullptr;
+        uint32_t sampleRate = 0;
+};
+
+// Base for the sources that stand in for a sound card: a thread that asks
+// next() for each buffer and hands it over at `speed` times real time, or
+// as fast as the consumers take it with a speed of 0. A paced source that
+// falls more than a buffer behind flags an input overflow, as a device
+// would, and picks the pace up again from there. Sources produce float;
+// for an Int16 stream the buffer is converted on the way out.
+class PacedSource : public SampleSource {
+    public:
+        PacedSource(float _speed);
+        PacedSource(const PacedSource&) = delete;
+        PacedSource& operator=(const PacedSource&) = delete;
+        // Subclasses have to stop() in their own destructor, while the
+        // members next() uses still exist
+        ~PacedSource();
+
+        bool start(SampleSink *_sink, uint32_t _channels, uint32_t &_sampleRate, uint32_t _framesPerBuffer,
+                   SampleFormat _format) override;
+        void stop() override;
+        bool isRunning() const;
+    protected:
+        // Settles the sample rate before the first next(); false if this
+        // source cannot run
+        virtual bool open(uint32_t &rate) = 0;
+        // Up to `frames` interleaved frames, NULL for silence. Sets `frames`
+        // to the number produced, 0 at the end of the data.
+        virtual const float* next(uint32_t &frames) = 0;
+
+        uint32_t channels = 0;
+        uint32_t sampleRate = 0;
+        uint32_t framesPerBuffer = 0;
+    private:
+        void run();
+
+        float speed;
+        SampleFormat format = SampleFormat::Float32;
+        std::vector<int16_t> converted;
+        SampleSink *sink = nullptr;
+        std::thread thread;
+        std::atomic<bool> running{false};
+};
+
+enum class GeneratorType {
+    Tone,
+    Noise,
+    Chirp
+};
+
+// A test signal on every channel: a sine, white noise, or a linear sweep
+// from freq0 to freq1 that starts over every `seconds`
+class GeneratorSource : public PacedSource {
+    public:
+        GeneratorSource(GeneratorType _type, float _freq0, float _freq1 = 0, float _seconds = CHIRP_SECONDS, float _speed = 1);
+        ~GeneratorSource();
+    protected:
+        bool open(uint32_t &rate) override;
+        const float* next(uint32_t &frames) override;
+    private:
+        GeneratorType type;
+        float freq0, freq1, seconds;
+        double phase = 0;
+        uint64_t sweepFrame = 0;
+        std::minstd_rand rng;
+        std::vector<float> buffer;
+};
+
+// Replays a capture, starting over at the end when `loop` is set. Buffers
+// are views straight into the file's mapping, or converted buffer by
+// buffer for a 16-bit file.
+class FileSource : public PacedSource {
+    public:
+        FileSource(const std::string &_path, float _speed = 1, bool _loop = true);
+        ~FileSource();
+    protected:
+        bool open(uint32_t &rate) override;
+        const float* next(uint32_t &frames) override;
+    private:
+        std::string path;
+        bool loop;
+        SampleFile file;
+        std::vector<float> buffer;
+        uint64_t position = 0;
+};
+
+// Endless silence, for timing everything downstream of the source
+class NullSource : public PacedSource {
+    public:
+        NullSource(float _speed = 1);
+        ~NullSource();
+    protected:
+        bool open(uint32_t &rate) override;
+        const float* next(uint32_t &frames) override;
+};
+
+enum class SourceType {
+    PortAudio,
+    File,
+    Tone,
+    Noise,
+    Chirp,
+    Null
+};
+
+struct SourceSpec {
+    SourceType type = SourceType::PortAudio;
+    std::string path;
+    float freq0 = 1000;
+    float freq1 = 0;
+    float seconds = CHIRP_SECONDS;
+};
+
+// "portaudio", "file:<path>", "tone:<hz>", "noise", "chirp:<hz>:<hz>[:<seconds>]" or "null"
+bool parseSource(const char *name, SourceSpec &spec) {
+    std::string str = name;
+    size_t colon = str.find(':');
+    std::string kind = str.substr(0, colon);
+    std::string args = colon == std::string::npos ? std::string() : str.substr(colon + 1);
+    const char *a = args.c_str();
+    char *end;
+
+    spec = SourceSpec();
+    if (kind == "portaudio" && args.empty()) spec.type = SourceType::PortAudio;
+    else if (kind == "null" && args.empty()) spec.type = SourceType::Null;
+    else if (kind == "noise" && args.empty()) spec.type = SourceType::Noise;
+    else if (kind == "file" && !args.empty()) {
+        spec.type = SourceType::File;
+        spec.path = args;
+    } else if (kind == "tone") {
+        spec.type = SourceType::Tone;
+        spec.freq0 = strtof(a, &end);
+        if (end == a || *end != '\0') return false;
+    } else if (kind == "chirp") {
+        spec.type = SourceType::Chirp;
+        spec.freq0 = strtof(a, &end);
+        if (end == a || *end != ':') return false;
+        a = end + 1;
+        spec.freq1 = strtof(a, &end);
+        if (end == a) return false;
+        if (*end == ':') {
+            a = end + 1;
+            spec.seconds = strtof(a, &end);
+            if (end == a || spec.seconds <= 0) return false;
+        }
+        if (*end != '\0') return false;
+    }
+    else return false;
+    return true;
+}
+
+// `device` is only used by the PortAudio source, `speed` by the others
+std::unique_ptr<SampleSource> makeSource(const SourceSpec &spec, PaDeviceIndex device, float speed) {
+    switch (spec.type) {
+        case SourceType::File: return std::make_unique<FileSource>(spec.path, speed);
+        case SourceType::Tone: return std::make_unique<GeneratorSource>(GeneratorType::Tone, spec.freq0, 0, 0, speed);
+        case SourceType::Noise: return std::make_unique<GeneratorSource>(GeneratorType::Noise, 0, 0, 0, speed);
+        case SourceType::Chirp:
+            return std::make_unique<GeneratorSource>(GeneratorType::Chirp, spec.freq0, spec.freq1, spec.seconds, speed);
+        case SourceType::Null: return std::make_unique<NullSource>(speed);
+        default: return std::make_unique<PortAudioSource>(device);
+    }
+}
+
+PortAudioSource::PortAudioSource(PaDeviceIndex _device)
+    : device(_device)
+{ }
+
+PortAudioSource::~PortAudioSource() {
+    stop();
+}
+
+bool PortAudioSource::start(SampleSink *_sink, uint32_t channels, uint32_t &_sampleRate, uint32_t framesPerBuffer,
+                            SampleFormat format) {
+    PaError err = Pa_Initialize();
+    if (err != paNoError) {
+        std::cout << "Failed to initialize PortAudio: " << Pa_GetErrorText(err) << std::endl;
+        return false;
+    }
+
+    PaStreamParameters inputParameters;
+    inputParameters.channelCount = channels;
+    inputParameters.sampleFormat = format == SampleFormat::Int16 ? paInt16 : paFloat32;
+    inputParameters.device = device == paNoDevice ? Pa_GetDefaultInputDevice() : device;
+    inputParameters.hostApiSpecificStreamInfo = NULL;
+    if (inputParameters.device == paNoDevice) {
+        fprintf(stderr, "Error: No default input device.\n");
+        return false;
+    }
+    const PaDeviceInfo *info = Pa_GetDeviceInfo(inputParameters.device);
+    if (info == NULL || (uint32_t) info->maxInputChannels < channels) {
+        std::cout << "Failed to open " << channels << " input channels on device "
+                  << inputParameters.device << std::endl;
+        return false;
+    }
+    inputParameters.suggestedLatency = info->defaultLowInputLatency;
+    if (_sampleRate == 0) _sampleRate = (uint32_t) info->defaultSampleRate;
+    sampleRate = _sampleRate;
+    sink = _sink;
+
+    err = Pa_OpenStream(&stream, &inputParameters,
+                        NULL, sampleRate,
+                        framesPerBuffer, paClipOff,
+                        &PortAudioSource::pAudioCallback, this);
+    if (err != paNoError) {
+        std::cout << "Failed to open input stream: " << Pa_GetErrorText(err) << std::endl;
+        stream = nullptr;
+        return false;
+    }
+
+    err = Pa_StartStream(stream);
+    if (err != paNoError) {
+        std::cout << "Failed to start input stream: " << Pa_GetErrorText(err) << std::endl;
+        Pa_CloseStream(stream);
+        stream = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void PortAudioSource::stop() {
+    if (stream != nullptr) {
+        Pa_StopStream(stream);
+        Pa_CloseStream(stream);
+        stream = nullptr;
+    }
+}
+
+int PortAudioSource::pAudioCallback(
+        const void *inputBuffer, void *outputBuffer,
+        unsigned long framesPerBuffer,
+        const PaStreamCallbackTimeInfo *timeInfo,
+        PaStreamCallbackFlags statusFlags,
+        void *userData
+        )
+{
+    TimePoint entered = std::chrono::steady_clock::now();
+    PortAudioSource *source = static_cast<PortAudioSource*>(userData);
+
+    (void) outputBuffer; /* Prevent unused variable warnings. */
+
+    // PortAudio times are on the stream's own clock; the offset between
+    // currentTime and now moves the ADC time onto steady_clock
+    TimePoint adc;
+    if (timeInfo != NULL && timeInfo->inputBufferAdcTime > 0 && timeInfo->currentTime > timeInfo->inputBufferAdcTime) {
+        adc = entered - std::chrono::nanoseconds((int64_t) ((timeInfo->currentTime - timeInfo->inputBufferAdcTime) * 1e9));
+    }
+    source->sink->deliver(inputBuffer, framesPerBuffer, adc, statusFlags);
+    return paContinue;
+}
+
+PacedSource::PacedSource(float _speed)
+    : speed(_speed < 0 ? 0 : _speed)
+{ }
+
+PacedSource::~PacedSource() {
+    stop();
+}
+
+bool PacedSource::start(SampleSink *_sink, uint32_t _channels, uint32_t &_sampleRate, uint32_t _framesPerBuffer,
+                        SampleFormat _format) {
+    if (running) return true;
+    // Reap a thread that ended by itself at the end of its data
+    if (thread.joinable()) thread.join();
+    channels = _channels;
+    framesPerBuffer = _framesPerBuffer;
+    format = _format;
+    converted.resize(format == SampleFormat::Int16 ? (size_t) framesPerBuffer * channels : 0);
+    if (!open(_sampleRate)) return false;
+    sampleRate = _sampleRate;
+    sink = _sink;
+    running = true;
+    thread = std::thread(&PacedSource::run, this);
+    return true;
+}
+
+void PacedSource::stop() {
+    running = false;
+    if (thread.joinable()) thread.join();
+}
+
+// False once stopped or out of data
+bool PacedSource::isRunning() const {
+    return running;
+}
+
+void PacedSource::run() {
+    // Stream time runs `speed` times faster than steady_clock
+    double nsPerFrame = speed > 0 ? 1e9/(sampleRate*speed) : 0;
+    auto due = [&](uint64_t frame) {
+        return std::chrono::nanoseconds((int64_t) (frame*nsPerFrame));
+    };
+    TimePoint begin = std::chrono::steady_clock::now();
+    uint64_t frames = 0;
+
+    while (running) {
+        PaStreamCallbackFlags flags = 0;
+        if (speed > 0) {
+            // A buffer is due once its last frame would have been captured
+            TimePoint ready = begin + due(frames + framesPerBuffer);
+            TimePoint now = std::chrono::steady_clock::now();
+            if (now > ready + due(framesPerBuffer)) {
+                flags |= paInputOverflow;
+                begin = now - due(frames + framesPerBuffer);
+            } else {
+                std::this_thread::sleep_until(ready);
+            }
+        } else {
+            while (running && sink->space() < framesPerBuffer) {
+                std::this_thread::sleep_for(std::chrono::microseconds(SOURCE_WAIT_US));
+            }
+            if (!running) break;
+        }
+
+        uint32_t n = framesPerBuffer;
+        const float *data = next(n);
+        if (n == 0) {
+            // Out of data, start() can run the source again
+            running = false;
+            break;
+        }
+        const void *out = data;
+        if (data != NULL && format == SampleFormat::Int16) {
+            floatToQ15(data, converted.data(), n * channels);
+            out = converted.data();
+        }
+        sink->deliver(out, n, speed > 0 ? begin + due(frames) : TimePoint(), flags);
+        frames += n;
+    }
+}
+
+GeneratorSource::GeneratorSource(GeneratorType _type, float _freq0, float _freq1, float _seconds, float _speed)
+    : PacedSource(_speed),
+      type(_type),
+      freq0(_freq0),
+      freq1(_freq1),
+      seconds(_seconds)
+{ }
+
+GeneratorSource::~GeneratorSource() {
+    stop();
+}
+
+bool GeneratorSource::open(uint32_t &rate) {
+    if (rate == 0) rate = GENERATOR_RATE;
+    if (type == GeneratorType::Chirp && seconds * rate < 1) return false;
+    buffer.resize((size_t) framesPerBuffer * channels);
+    phase = 0;
+    sweepFrame = 0;
+    return true;
+}
+
+const float* GeneratorSource::next(uint32_t &frames) {
+    std::uniform_real_distribution<float> noise(-GENERATOR_AMPLITUDE, GENERATOR_AMPLITUDE);
+    uint64_t sweepFrames = (uint64_t) (seconds * sampleRate);
+    for (uint32_t f = 0; f < frames; f++) {
+        float x;
+        if (type == GeneratorType::Noise) {
+            x = noise(rng);
+        } else {
+            double freq = freq0;
+            if (type == GeneratorType::Chirp) {
+                freq += (double) (freq1 - freq0) * sweepFrame / sweepFrames;
+                if (++sweepFrame >= sweepFrames) sweepFrame = 0;
+            }
+            x = GENERATOR_AMPLITUDE * std::sin(phase);
+            phase += 2*M_PI*freq/sampleRate;
+            if (phase >= 2*M_PI) phase -= 2*M_PI;
+        }
+        for (uint32_t c = 0; c < channels; c++) buffer[f*channels + c] = x;
+    }
+    return buffer.data();
+}
+
+FileSource::FileSource(const std::string &_path, float _speed, bool _loop)
+    : PacedSource(_speed),
+      path(_path),
+      loop(_loop)
+{ }
+
+FileSource::~FileSource() {
+    stop();
+}
+
+// Raw captures are taken to be at the requested rate
+bool FileSource::open(uint32_t &rate) {
+    if (!file.open(path.c_str(), channels, rate == 0 ? RAW_SOURCE_RATE : rate)) return false;
+    if (file.getChannels() != channels || file.getNumFrames() == 0) {
+        std::cout << "Failed to replay \'" << path << "\', need " << channels << " channel(s) and has "
+                  << file.getChannels() << " with " << file.getNumFrames() << " frames" << std::endl;
+        return false;
+    }
+    if (rate != 0 && rate != file.getSampleRate()) {
+        std::cout << "Failed to replay \'" << path << "\' at " << rate << " Hz, it was captured at "
+                  << file.getSampleRate() << " Hz" << std::endl;
+        return false;
+    }
+    rate = file.getSampleRate();
+    buffer.resize(file.getFormat() == SampleFormat::Int16 ? (size_t) framesPerBuffer * channels : 0);
+    position = 0;
+    return true;
+}
+
+const float* FileSource::next(uint32_t &frames) {
+    if (position == file.getNumFrames() && loop) position = 0;
+    uint64_t left = file.getNumFrames() - position;
+    if (frames > left) frames = left;
+    const float *view = file.read(position, frames, buffer.data());
+    position += frames;
+    return view;
+}
+
+NullSource::NullSource(float _speed)
+    : PacedSource(_speed)
+{ }
+
+NullSource::~NullSource() {
+    stop();
+}
+
+bool NullSource::open(uint32_t &rate) {
+    if (rate == 0) rate = GENERATOR_RATE;
+    return true;
+}
+
+const float* NullSource::next(uint32_t &frames) {
+    (void) frames;
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef SLIDING_DFT_H
+#define SLIDING_DFT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#include "DBKernel.hpp"
+#include "STFT.hpp"
+
+#define SDFT_DAMPING    0.99999     // pole radius, bleeds off rounding error instead of letting it grow
+#define SDFT_ALIGN      8           // internal bin arrays are padded to a multiple of this
+
+// Tracks a handful of DFT bins of a `windowSize` window that slides one
+// sample at a time. Each bin costs one complex multiply-add per sample, so
+// watching a few dozen tones (e.g. for tone detection) is far cheaper than
+// a full transform per hop and has no hop latency at all. Bins are kept as
+// separate real and imaginary arrays and updated eight at a time.
+// A Hann window is applied in the frequency domain from the two
+// neighbouring bins, which are tracked alongside; any window other than
+// Rectangular is treated as Hann.
+class SlidingDFT {
+    public:
+        SlidingDFT(uint32_t _windowSize, const std::vector<uint32_t> &_bins, WindowType windowType = WindowType::Hann);
+        SlidingDFT(const SlidingDFT&) = delete;
+        SlidingDFT& operator=(const SlidingDFT&) = delete;
+
+        void update(const float *input, uint32_t n);
+        uint32_t process(const float *input, uint32_t n, uint32_t every, float *dB);
+        void levels(float *dB) const;
+        void reset();
+
+        uint32_t getWindowSize() const;
+        uint32_t getNumBins() const;
+        uint32_t getBin(uint32_t i) const;
+
+        static uint32_t binFor(float freq, float sampleRate, uint32_t size);
+    private:
+        void step(float x);
+
+        uint32_t windowSize;
+        std::vector<uint32_t> bins;
+        bool hann;
+        uint32_t stride;                // padded bin count per plane
+        float dampingN;                 // SDFT_DAMPING^windowSize, applied to the sample leaving the window
+        float scale;
+        std::vector<float> cosW, sinW;  // damped twiddles; planes of `stride`: bin, bin - 1, bin + 1
+        std::vector<float> re, im;
+        std::vector<float> history;     // last windowSize samples
+        uint32_t oldest = 0;
+        uint32_t untilNext = 0;
+};
+
+SlidingDFT::SlidingDFT(uint32_t _windowSize, const std::vector<uint32_t> &_bins, WindowType windowType)
+    : windowSize(_windowSize),
+      bins(_bins),
+      hann(windowType != WindowType::Rectangular),
+      stride((_bins.size() + SDFT_ALIGN - 1)/SDFT_ALIGN*SDFT_ALIGN),
+      dampingN(std::pow(SDFT_DAMPING, _windowSize)),
+      scale(amplitudeScale(_windowSize)),
+      history(_windowSize, 0)
+{
+    uint32_t planes = hann ? 3 : 1;
+    int32_t offsets[3] = {0, -1, 1};
+    cosW.assign(planes*stride, 0);
+    sinW.assign(planes*stride, 0);
+    for (uint32_t p = 0; p < planes; p++) {
+        for (uint32_t i = 0; i < bins.size(); i++) {
+            int32_t k = (int32_t) bins[i] + offsets[p];
+            double w = 2*M_PI*k/windowSize;
+            cosW[p*stride + i] = SDFT_DAMPING*std::cos(w);
+            sinW[p*stride + i] = SDFT_DAMPING*std::sin(w);
+        }
+    }
+    reset();
+}
+
+void SlidingDFT::reset() {
+    re.assign(cosW.size(), 0);
+    im.assign(cosW.size(), 0);
+    std::fill(history.begin(), history.end(), 0.0f);
+    oldest = 0;
+    untilNext = 0;
+}
+
+// X = r*e^(jw)*(X + x[n] - r^N*x[n - N]) for every tracked bin
+void SlidingDFT::step(float x) {
+    float delta = x - dampingN*history[oldest];
+    history[oldest] = x;
+    if (++oldest == windowSize) oldest = 0;
+
+    uint32_t n = cosW.size();
+    uint32_t i = 0;
+#if defined(__AVX__)
+    const __m256 vDelta = _mm256_set1_ps(delta);
+    for (; i < n; i += 8) {
+        __m256 a = _mm256_add_ps(_mm256_loadu_ps(&re[i]), vDelta);
+        __m256 b = _mm256_loadu_ps(&im[i]);
+        __m256 c = _mm256_loadu_ps(&cosW[i]);
+        __m256 s = _mm256_loadu_ps(&sinW[i]);
+        _mm256_storeu_ps(&re[i], _mm256_sub_ps(_mm256_mul_ps(c, a), _mm256_mul_ps(s, b)));
+        _mm256_storeu_ps(&im[i], _mm256_add_ps(_mm256_mul_ps(s, a), _mm256_mul_ps(c, b)));
+    }
+#elif defined(__SSE__)
+    const __m128 vDelta = _mm_set1_ps(delta);
+    for (; i < n; i += 4) {
+        __m128 a = _mm_add_ps(_mm_loadu_ps(&re[i]), vDelta);
+        __m128 b = _mm_loadu_ps(&im[i]);
+        __m128 c = _mm_loadu_ps(&cosW[i]);
+        __m128 s = _mm_loadu_ps(&sinW[i]);
+        _mm_storeu_ps(&re[i], _mm_sub_ps(_mm_mul_ps(c, a), _mm_mul_ps(s, b)));
+        _mm_storeu_ps(&im[i], _mm_add_ps(_mm_mul_ps(s, a), _mm_mul_ps(c, b)));
+    }
+#endif
+    for (; i < n; i++) {
+        float a = re[i] + delta, b = im[i];
+        re[i] = cosW[i]*a - sinW[i]*b;
+        im[i] = sinW[i]*a + cosW[i]*b;
+    }
+}
+
+void SlidingDFT::update(const float *input, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) step(input[i]);
+}
+
+// Like update(), but after every `every` samples (counted across calls)
+// writes a row of getNumBins() levels to `dB`, which must hold
+// (n/every + 1) rows. An `every` of 0 is taken as 1. Returns the number of
+// rows written.
+uint32_t SlidingDFT::process(const float *input, uint32_t n, uint32_t every, float *dB) {
+    uint32_t rows = 0;
+    if (every == 0) every = 1;
+    if (untilNext == 0 || untilNext > every) untilNext = every;
+    for (uint32_t i = 0; i < n; i++) {
+        step(input[i]);
+        if (--untilNext == 0) {
+            levels(&dB[rows*bins.size()]);
+            rows++;
+            untilNext = every;
+        }
+    }
+    return rows;
+}
+
+// Current level of each tracked bin, on the same 20*log10(2|X|/N) scale
+// as the spectrum display
+void SlidingDFT::levels(float *dB) const {
+    for (uint32_t i = 0; i < bins.size(); i++) {
+        float x = re[i], y = im[i];
+        if (hann) {
+            // Periodic Hann scaled to unity coherent gain like STFT::computeWindow:
+            // X[k] - 0.5*(X[k - 1] + X[k + 1])
+            x -= 0.5f*(re[stride + i] + re[2*stride + i]);
+            y -= 0.5f*(im[stride + i] + im[2*stride + i]);
+        }
+        dB[i] = powerToDB(scale*(x*x + y*y));
+    }
+}
+
+uint32_t SlidingDFT::getWindowSize() const {
+    return windowSize;
+}
+
+uint32_t SlidingDFT::getNumBins() const {
+    return bins.size();
+}
+
+uint32_t SlidingDFT::getBin(uint32_t i) const {
+    return bins[i];
+}
+
+// Nearest bin to `freq`, clamped to the positive half of the spectrum
+uint32_t SlidingDFT::binFor(float freq, float sampleRate, uint32_t size) {
+    float bin = std::round(freq*size/sampleRate);
+    if (bin < 0) return 0;
+    if (bin > size/2) return size/2;
+    return (uint32_t) bin;
+}
+
+#endif
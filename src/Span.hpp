@@ -0,0 +1,116 @@
+#ifndef SPAN_H
+#define SPAN_H
+
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+// Non-owning view of contiguous elements, a minimal stand-in for the C++20
+// std::span. Span<T> converts to Span<const T>, and anything with data()
+// and size() (std::vector, std::array) converts implicitly.
+template <typename T>
+class Span {
+    template <typename C>
+    using ContainerOf = std::enable_if_t<std::is_convertible<decltype(std::declval<C&>().data()), T*>::value>;
+
+    public:
+        Span();
+        Span(T *_ptr, size_t _len);
+        template <typename U, typename = std::enable_if_t<std::is_convertible<U(*)[], T(*)[]>::value>>
+        Span(const Span<U> &other);
+        template <typename C, typename = ContainerOf<C>>
+        Span(C &container);
+
+        T* data() const;
+        size_t size() const;
+        bool empty() const;
+        T& operator[](size_t i) const;
+        T* begin() const;
+        T* end() const;
+        Span subspan(size_t offset, size_t count) const;
+    private:
+        T *ptr;
+        size_t len;
+};
+
+// A ring buffer region, which wraps at most once: `first` runs up to the
+// end of storage and `second` continues from its start.
+template <typename T>
+struct SpanPair {
+    Span<T> first;
+    Span<T> second;
+
+    size_t size() const;
+    bool empty() const;
+    void copyTo(std::remove_const_t<T> *output) const;
+};
+
+template <typename T>
+Span<T>::Span() : ptr(nullptr), len(0) { }
+
+template <typename T>
+Span<T>::Span(T *_ptr, size_t _len) : ptr(_ptr), len(_len) { }
+
+template <typename T>
+template <typename U, typename>
+Span<T>::Span(const Span<U> &other) : ptr(other.data()), len(other.size()) { }
+
+template <typename T>
+template <typename C, typename>
+Span<T>::Span(C &container) : ptr(container.data()), len(container.size()) { }
+
+template <typename T>
+T* Span<T>::data() const {
+    return ptr;
+}
+
+template <typename T>
+size_t Span<T>::size() const {
+    return len;
+}
+
+template <typename T>
+bool Span<T>::empty() const {
+    return len == 0;
+}
+
+template <typename T>
+T& Span<T>::operator[](size_t i) const {
+    return ptr[i];
+}
+
+template <typename T>
+T* Span<T>::begin() const {
+    return ptr;
+}
+
+template <typename T>
+T* Span<T>::end() const {
+    return ptr + len;
+}
+
+template <typename T>
+Span<T> Span<T>::subspan(size_t offset, size_t count) const {
+    if (offset > len) offset = len;
+    if (count > len - offset) count = len - offset;
+    return Span(ptr + offset, count);
+}
+
+template <typename T>
+size_t SpanPair<T>::size() const {
+    return first.size() + second.size();
+}
+
+template <typename T>
+bool SpanPair<T>::empty() const {
+    return size() == 0;
+}
+
+template <typename T>
+void SpanPair<T>::copyTo(std::remove_const_t<T> *output) const {
+    if (!first.empty()) std::memcpy(output, first.data(), sizeof(T) * first.size());
+    if (!second.empty()) std::memcpy(output + first.size(), second.data(), sizeof(T) * second.size());
+}
+
+#endif
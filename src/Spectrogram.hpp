@@ -8,31 +8,52 @@
 #include <SFML/System/Vector2.hpp>
 #include <fftw3.h>
 #include <cmath>
+#include <iomanip>
 #include <sstream>
+#include <vector>
+
+#include "DBKernel.hpp"
+#include "FrequencyAxis.hpp"
 
 class Spectrogram {
     public:
-      Spectrogram(sf::RenderWindow *_window, fftwf_complex *_dft,
-                  uint32_t _fftSize, uint32_t _fundFreq, sf::Vector2f origin,
+      Spectrogram(sf::RenderTarget *_window, fftwf_complex *_dft,
+                  uint32_t _fftSize, float _fundFreq, sf::Vector2f origin,
                   sf::Vector2f _size, sf::Vector2f _dBRange);
       Spectrogram(const Spectrogram& OTHER) = delete;
+      void setDFT(fftwf_complex *_dft);
       void drawBars();
+      void drawBars(const float *dB);
       void clearBars(sf::Color color);
       void drawAxis();
+      void setSize(sf::Vector2f _size);
+      void setDBRange(sf::Vector2f _dBRange);
+      void setAxis(const FrequencyAxis &_axis);
     private:
-        sf::RenderWindow *window;
+        void layout();
+        void buildAxis();
+
+        sf::RenderTarget *window;
         fftwf_complex *dft;
-        uint32_t fftSize, fundFreq;
+        uint32_t fftSize;
+        float fundFreq;
+        FrequencyAxis axis;     // what drawBars(dB) is given, linear FFT bins by default
         sf::Vector2f origin;
         sf::Vector2f size; // width, height
         sf::Vector2f dBRange; // min, max
         const float margin = 50;
         const sf::Vector2u numLabels = sf::Vector2u({5, 5});
         sf::Font font;
+        std::vector<float> dBBuf;
+        sf::VertexArray bars;
+        std::vector<uint32_t> barBegin, barEnd;    // bins [begin, end) under each bar
+        size_t numBars;
+        sf::RectangleShape background;
+        std::vector<sf::Text> labels;
 };
 
-Spectrogram::Spectrogram(sf::RenderWindow *_window, fftwf_complex *_dft,
-                         uint32_t _fftSize, uint32_t _fundFreq,
+Spectrogram::Spectrogram(sf::RenderTarget *_window, fftwf_complex *_dft,
+                         uint32_t _fftSize, float _fundFreq,
                          sf::Vector2f _origin, sf::Vector2f _size,
                          sf::Vector2f _dBRange) {
     window = _window;
@@ -42,19 +63,77 @@ Spectrogram::Spectrogram(sf::RenderWindow *_window, fftwf_complex *_dft,
     origin = _origin;
     size = _size;
     dBRange = _dBRange;
+    axis = FrequencyAxis::fft(fftSize/2 + 1, fundFreq, false);
+    dBBuf.resize(fftSize/2 + 1);
     if(!font.openFromFile("/usr/share/fonts/liberation/LiberationMono-Regular.ttf")) {};
+    layout();
+    buildAxis();
 }
 
-void Spectrogram::drawAxis() {
-    sf::Text text(font);
+void Spectrogram::setDFT(fftwf_complex *_dft) {
+    dft = _dft;
+}
+
+void Spectrogram::setSize(sf::Vector2f _size) {
+    size = _size;
+    layout();
+    buildAxis();
+}
+
+void Spectrogram::setDBRange(sf::Vector2f _dBRange) {
+    dBRange = _dBRange;
+    buildAxis();
+}
+
+// E.g. a log axis, or constant-Q bins. drawBars() from the DFT still
+// assumes linear FFT bins.
+void Spectrogram::setAxis(const FrequencyAxis &_axis) {
+    axis = _axis;
+    layout();
+    buildAxis();
+}
+
+// Bar geometry only depends on the plot size, so x positions and colors
+// are written here once and drawBars just moves the bar tops.
+void Spectrogram::layout() {
+    uint32_t numBins = axis.numBins();
+    float plotWidth = size.x - 2*margin;
+
+    // Never draw more bars than there are pixel columns
+    uint32_t columns = plotWidth > 1 ? (uint32_t) plotWidth : 1;
+    numBars = numBins <= columns ? numBins : columns;
+    axis.group(numBars, barBegin, barEnd);
+
+    float barWidth = plotWidth/numBars;
+    bars.setPrimitiveType(sf::PrimitiveType::Triangles);
+    bars.resize(numBars*6);
+    for (size_t i = 0; i < numBars; i++) {
+        sf::Vector2f p0 = origin + sf::Vector2f(i*barWidth + margin, size.y - margin);
+        sf::Vector2f p2 = p0 + sf::Vector2f(barWidth, 0);
+
+        bars[6*i + 0].position = p0;
+        bars[6*i + 1].position = p0;
+        bars[6*i + 2].position = p2;
+        bars[6*i + 3].position = p0;
+        bars[6*i + 4].position = p2;
+        bars[6*i + 5].position = p2;
+        for (size_t v = 0; v < 6; v++) bars[6*i + v].color = sf::Color::White;
+    }
+
+    background.setPosition(origin + sf::Vector2f({margin, margin}));
+    background.setSize(size - sf::Vector2f({2*margin, 2*margin}));
+}
+
+// Labels only change with the size or dB range, so the text objects are
+// kept between frames
+void Spectrogram::buildAxis() {
     const uint32_t fontSize = 14;
-    text.setCharacterSize(fontSize);
+    labels.clear();
 
     // Frequency axis
-    float xLabelStep = (size.x - 2*margin)/(numLabels.x - 1);
-    float freqStep = ((float) fundFreq * fftSize)/(numLabels.x - 1);
+    float plotWidth = size.x - 2*margin;
     for (size_t i = 0; i < numLabels.x; i++) {
-        float freq = freqStep*i;
+        float freq = axis.labelFrequency(i, numLabels.x);
         std::stringstream ss;
         ss << std::fixed << std::setprecision(1);
         if (freq > 1000) {
@@ -63,10 +142,10 @@ void Spectrogram::drawAxis() {
             ss << freq << " Hz";
         }
 
-        text.setString(ss.str());
-        float xpos = i == 0 ? margin : i*xLabelStep;
+        sf::Text text(font, ss.str(), fontSize);
+        float xpos = i == 0 ? margin : axis.position(freq)*plotWidth;
         text.setPosition(sf::Vector2f({xpos, size.y - margin}));
-        window->draw(text);
+        labels.push_back(text);
     }
 
     // dB axis
@@ -74,52 +153,46 @@ void Spectrogram::drawAxis() {
     float dBStep = ((float) dBRange.y - dBRange.x)/(numLabels.y - 1);
     float xpos = (margin - 3*fontSize)/2;
     for (size_t i = 0; i < numLabels.y; i++) {
-        text.setString(std::to_string((int32_t) (dBRange.x + dBStep*i)) + "dB");
+        sf::Text text(font, std::to_string((int32_t) (dBRange.x + dBStep*i)) + "dB", fontSize);
         float ypos = i == 0 ? size.y - margin - fontSize : size.y - i*yLabelStep - margin/2 - fontSize;
         text.setPosition(sf::Vector2f({xpos, ypos}));
-        window->draw(text);
+        labels.push_back(text);
     }
 }
 
+void Spectrogram::drawAxis() {
+    for (const sf::Text &text : labels) window->draw(text);
+}
+
 void Spectrogram::clearBars(sf::Color color) {
-    sf::RectangleShape rectangle;
-    rectangle.setPosition(origin + sf::Vector2f({margin, margin}));
-    rectangle.setSize(size - sf::Vector2f({2*margin, 2*margin}));
-    rectangle.setFillColor(color);
-    window->draw(rectangle);
+    background.setFillColor(color);
+    window->draw(background);
 }
 
 void Spectrogram::drawBars() {
-    size_t numBars = (fftSize/2) + 1;
-    float barWidth = (size.x - 2*margin)/numBars;
+    spectrumToDB(dft, dBBuf.data(), (fftSize/2) + 1, amplitudeScale(fftSize));
+    drawBars(dBBuf.data());
+}
+
+// Draws precomputed magnitudes, one per bin of the axis, in dB. When there
+// are more bins than pixel columns each bar shows the peak of the bins
+// under it.
+void Spectrogram::drawBars(const float *magnitudes) {
     float maxHeight = size.y - 2*margin;
-    sf::VertexArray bars(sf::PrimitiveType::Triangles, numBars*6);
+    float baseline = origin.y + size.y - margin;
 
     for (size_t i = 0; i < numBars; i++) {
-        double magnitude = sqrt(pow(dft[i][0], 2) + pow(dft[i][1], 2));
-        double dB = 20*log10((2*magnitude)/fftSize);
+        float dB = magnitudes[barBegin[i]];
+        for (uint32_t b = barBegin[i] + 1; b < barEnd[i]; b++) {
+            if (magnitudes[b] > dB) dB = magnitudes[b];
+        }
         if (dB < dBRange.x) dB = dBRange.x; // clamp to min
         if (dB > dBRange.y) dB = dBRange.y; // clamp to max
-        double percentage = (dB - dBRange.x)/(dBRange.y - dBRange .x);
+        float top = baseline - maxHeight*(dB - dBRange.x)/(dBRange.y - dBRange.x);
 
-        sf::Vector2f p0 = origin + sf::Vector2f(i*barWidth + margin, size.y - margin);
-        sf::Vector2f p1 = p0 - sf::Vector2f(0, maxHeight*percentage);
-        sf::Vector2f p2 = p0 + sf::Vector2f(barWidth, 0);
-        sf::Vector2f p3 = p1 + sf::Vector2f(barWidth, 0);
-
-        bars[6*i + 0].position = p0;
-        bars[6*i + 1].position = p1;
-        bars[6*i + 2].position = p2;
-        bars[6*i + 3].position = p1;
-        bars[6*i + 4].position = p2;
-        bars[6*i + 5].position = p3;
-
-        bars[6*i + 0].color = sf::Color::White;
-        bars[6*i + 1].color = sf::Color::White;
-        bars[6*i + 2].color = sf::Color::White;
-        bars[6*i + 3].color = sf::Color::White;
-        bars[6*i + 4].color = sf::Color::White;
-        bars[6*i + 5].color = sf::Color::White;
+        bars[6*i + 1].position.y = top;
+        bars[6*i + 3].position.y = top;
+        bars[6*i + 5].position.y = top;
     }
 
     window->draw(bars);
@@ -0,0 +1,297 @@
+#ifndef SPECTRUM_AVERAGER_H
+#define SPECTRUM_AVERAGER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+
+#define AVERAGE_FRAMES          8       // default length of the exponential and linear averages
+#define PEAK_DECAY_DB           0.5f    // default fall of a held peak per frame
+#define QUANTILES               {0.5f, 0.95f}
+#define QUANTILE_START_DB       6.0f    // first step of the percentile estimates...
+#define QUANTILE_STEP_DB        0.05f   // ...shrinking to this, which still follows slow drift
+#define QUANTILE_SETTLE_FRAMES  64      // frames for the step to halve
+
+enum class AverageMode {
+    None,
+    Exponential,
+    Linear,
+    PeakHold,
+    Percentile
+};
+
+struct AverageSpec {
+    AverageMode mode = AverageMode::None;
+    float param = 0;    // frames, dB per frame or quantile, by mode
+};
+
+// "none", "exp[:<frames>]", "linear[:<frames>]", "peak[:<dB per frame>]", "p50" or "p95"
+bool parseAverage(const char *name, AverageSpec &spec) {
+    std::string str = name;
+    size_t colon = str.find(':');
+    std::string kind = str.substr(0, colon);
+    bool hasArg = colon != std::string::npos;
+    const char *a = hasArg ? name + colon + 1 : "";
+    char *end;
+
+    spec = AverageSpec();
+    if (kind == "none" && !hasArg) return true;
+    if (kind == "p50" && !hasArg) spec.param = 0.5f;
+    else if (kind == "p95" && !hasArg) spec.param = 0.95f;
+    if (spec.param > 0) {
+        spec.mode = AverageMode::Percentile;
+        return true;
+    }
+
+    if (kind == "exp") spec.mode = AverageMode::Exponential;
+    else if (kind == "linear") spec.mode = AverageMode::Linear;
+    else if (kind == "peak") spec.mode = AverageMode::PeakHold;
+    else return false;
+    spec.param = spec.mode == AverageMode::PeakHold ? PEAK_DECAY_DB : AVERAGE_FRAMES;
+    if (!hasArg) return true;
+    spec.param = strtof(a, &end);
+    if (end == a || *end != '\0') return false;
+    return spec.mode == AverageMode::PeakHold ? spec.param >= 0 : spec.param >= 1;
+}
+
+// Aggregates successive dB spectra between the FFT and the display.
+// Exponential and linear averages steady a flickering spectrum, peak-hold
+// keeps each bin's maximum and lets it fall by a fixed step per frame, and
+// the percentile mode keeps running P50 and P95 estimates per bin for
+// watching the noise floor of a continuous stream. Every mode costs O(bins)
+// per frame in fixed memory and runs across bins eight at a time.
+// Everything works on dB values, so the averages are log averages, like a
+// spectrum analyzer's video averaging: tones read the same, noise reads
+// about 2.5 dB below a power average.
+// The percentile estimates are one float per bin and quantile: each frame
+// moves an estimate up by q*step if the bin is above it and down by
+// (1 - q)*step otherwise, which settles where a fraction q of the frames
+// lie below. The step starts large so a new stream settles quickly.
+class SpectrumAverager {
+    public:
+        SpectrumAverager(uint32_t _numBins, AverageMode _mode, float _param);
+        SpectrumAverager(const SpectrumAverager&) = delete;
+        SpectrumAverager& operator=(const SpectrumAverager&) = delete;
+
+        void add(const float *dB);
+        void read(float *dB) const;
+        float floorDB(float quantile) const;
+        void reset();
+
+        AverageMode getMode() const;
+        uint64_t getFrames() const;
+    private:
+        void addLinear(const float *dB);
+        void addPercentile(const float *dB);
+        const float* estimates(float quantile) const;
+
+        uint32_t numBins;
+        AverageMode mode;
+        float param;
+        uint32_t rows;                  // frames kept by the linear average
+        std::vector<float> quantiles;
+        std::vector<float> value;       // average, held peak or one plane per quantile
+        std::vector<float> history;     // linear: `rows` frames, oldest overwritten first
+        uint32_t nextRow = 0;
+        uint64_t frames = 0;
+};
+
+SpectrumAverager::SpectrumAverager(uint32_t _numBins, AverageMode _mode, float _param)
+    : numBins(_numBins),
+      mode(_mode),
+      param(_param),
+      rows(_mode == AverageMode::Linear ? std::max(1u, (uint32_t) _param) : 0),
+      quantiles(QUANTILES),
+      history((size_t) rows * _numBins)
+{
+    if (mode == AverageMode::Percentile) {
+        if (std::find(quantiles.begin(), quantiles.end(), param) == quantiles.end()) quantiles.push_back(param);
+        value.resize(quantiles.size() * numBins);
+    } else {
+        value.resize(numBins);
+    }
+    reset();
+}
+
+void SpectrumAverager::reset() {
+    std::fill(value.begin(), value.end(), 0.0f);
+    std::fill(history.begin(), history.end(), 0.0f);
+    nextRow = 0;
+    frames = 0;
+}
+
+void SpectrumAverager::add(const float *dB) {
+    // The first frame is taken as is so nothing ramps up from zero
+    if (frames == 0 && mode != AverageMode::Linear) {
+        for (uint32_t p = 0; p < value.size(); p += numBins) std::memcpy(&value[p], dB, sizeof(float) * numBins);
+        frames++;
+        return;
+    }
+
+    float *v = value.data();
+    uint32_t i = 0;
+    switch (mode) {
+        case AverageMode::Exponential: {
+            // v += (x - v)/param, a time constant of `param` frames
+            float alpha = 1.0f / std::max(param, 1.0f);
+#if defined(__AVX__)
+            const __m256 vAlpha = _mm256_set1_ps(alpha);
+            for (; i + 8 <= numBins; i += 8) {
+                __m256 old = _mm256_loadu_ps(&v[i]);
+                __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(&dB[i]), old);
+                _mm256_storeu_ps(&v[i], _mm256_add_ps(old, _mm256_mul_ps(vAlpha, diff)));
+            }
+#elif defined(__SSE__)
+            const __m128 vAlpha = _mm_set1_ps(alpha);
+            for (; i + 4 <= numBins; i += 4) {
+                __m128 old = _mm_loadu_ps(&v[i]);
+                __m128 diff = _mm_sub_ps(_mm_loadu_ps(&dB[i]), old);
+                _mm_storeu_ps(&v[i], _mm_add_ps(old, _mm_mul_ps(vAlpha, diff)));
+            }
+#endif
+            for (; i < numBins; i++) v[i] += alpha*(dB[i] - v[i]);
+            break;
+        }
+        case AverageMode::Linear:
+            addLinear(dB);
+            break;
+        case AverageMode::PeakHold: {
+            // v = max(x, v - decay)
+#if defined(__AVX__)
+            const __m256 vDecay = _mm256_set1_ps(param);
+            for (; i + 8 <= numBins; i += 8) {
+                __m256 fallen = _mm256_sub_ps(_mm256_loadu_ps(&v[i]), vDecay);
+                _mm256_storeu_ps(&v[i], _mm256_max_ps(_mm256_loadu_ps(&dB[i]), fallen));
+            }
+#elif defined(__SSE__)
+            const __m128 vDecay = _mm_set1_ps(param);
+            for (; i + 4 <= numBins; i += 4) {
+                __m128 fallen = _mm_sub_ps(_mm_loadu_ps(&v[i]), vDecay);
+                _mm_storeu_ps(&v[i], _mm_max_ps(_mm_loadu_ps(&dB[i]), fallen));
+            }
+#endif
+            for (; i < numBins; i++) v[i] = std::max(dB[i], v[i] - param);
+            break;
+        }
+        case AverageMode::Percentile:
+            addPercentile(dB);
+            break;
+        default:
+            std::memcpy(v, dB, sizeof(float) * numBins);
+            break;
+    }
+    frames++;
+}
+
+// The running sum is kept in `value`. Adding and removing frames leaves
+// rounding behind, so it is summed afresh from the history every time the
+// oldest row comes round again, which averages out to O(bins) per frame.
+void SpectrumAverager::addLinear(const float *dB) {
+    float *sum = value.data();
+    float *row = &history[(size_t) nextRow * numBins];
+    uint32_t i = 0;
+#if defined(__AVX__)
+    for (; i + 8 <= numBins; i += 8) {
+        __m256 x = _mm256_loadu_ps(&dB[i]);
+        __m256 delta = _mm256_sub_ps(x, _mm256_loadu_ps(&row[i]));
+        _mm256_storeu_ps(&sum[i], _mm256_add_ps(_mm256_loadu_ps(&sum[i]), delta));
+        _mm256_storeu_ps(&row[i], x);
+    }
+#elif defined(__SSE__)
+    for (; i + 4 <= numBins; i += 4) {
+        __m128 x = _mm_loadu_ps(&dB[i]);
+        __m128 delta = _mm_sub_ps(x, _mm_loadu_ps(&row[i]));
+        _mm_storeu_ps(&sum[i], _mm_add_ps(_mm_loadu_ps(&sum[i]), delta));
+        _mm_storeu_ps(&row[i], x);
+    }
+#endif
+    for (; i < numBins; i++) {
+        sum[i] += dB[i] - row[i];
+        row[i] = dB[i];
+    }
+
+    if (++nextRow == rows) {
+        nextRow = 0;
+        std::memcpy(sum, history.data(), sizeof(float) * numBins);
+        for (uint32_t r = 1; r < rows; r++) {
+            const float *h = &history[(size_t) r * numBins];
+            for (i = 0; i < numBins; i++) sum[i] += h[i];
+        }
+    }
+}
+
+void SpectrumAverager::addPercentile(const float *dB) {
+    float step = std::max(QUANTILE_STEP_DB, QUANTILE_START_DB * QUANTILE_SETTLE_FRAMES / (QUANTILE_SETTLE_FRAMES + frames));
+    for (uint32_t p = 0; p < quantiles.size(); p++) {
+        float up = quantiles[p]*step, down = -(1 - quantiles[p])*step;
+        float *v = &value[(size_t) p * numBins];
+        uint32_t i = 0;
+#if defined(__AVX__)
+        const __m256 vUp = _mm256_set1_ps(up), vDown = _mm256_set1_ps(down);
+        for (; i + 8 <= numBins; i += 8) {
+            __m256 est = _mm256_loadu_ps(&v[i]);
+            __m256 above = _mm256_cmp_ps(_mm256_loadu_ps(&dB[i]), est, _CMP_GT_OQ);
+            _mm256_storeu_ps(&v[i], _mm256_add_ps(est, _mm256_blendv_ps(vDown, vUp, above)));
+        }
+#elif defined(__SSE__)
+        const __m128 vUp = _mm_set1_ps(up), vDown = _mm_set1_ps(down);
+        for (; i + 4 <= numBins; i += 4) {
+            __m128 est = _mm_loadu_ps(&v[i]);
+            __m128 above = _mm_cmpgt_ps(_mm_loadu_ps(&dB[i]), est);
+            __m128 move = _mm_or_ps(_mm_and_ps(above, vUp), _mm_andnot_ps(above, vDown));
+            _mm_storeu_ps(&v[i], _mm_add_ps(est, move));
+        }
+#endif
+        for (; i < numBins; i++) v[i] += dB[i] > v[i] ? up : down;
+    }
+}
+
+// Writes the current aggregate, the selected percentile in that mode
+void SpectrumAverager::read(float *dB) const {
+    if (mode == AverageMode::Percentile) {
+        std::memcpy(dB, estimates(param), sizeof(float) * numBins);
+    } else if (mode == AverageMode::Linear) {
+        float scale = 1.0f / std::max<uint64_t>(1, std::min<uint64_t>(frames, rows));
+        for (uint32_t i = 0; i < numBins; i++) dB[i] = value[i]*scale;
+    } else {
+        std::memcpy(dB, value.data(), sizeof(float) * numBins);
+    }
+}
+
+// Median over bins of one percentile estimate, a single noise floor figure
+// for the stats. NAN outside the percentile mode.
+float SpectrumAverager::floorDB(float quantile) const {
+    const float *v = estimates(quantile);
+    if (v == nullptr || frames == 0) return NAN;
+    std::vector<float> sorted(v, v + numBins);
+    std::nth_element(sorted.begin(), sorted.begin() + numBins/2, sorted.end());
+    return sorted[numBins/2];
+}
+
+const float* SpectrumAverager::estimates(float quantile) const {
+    if (mode != AverageMode::Percentile) return nullptr;
+    for (uint32_t p = 0; p < quantiles.size(); p++) {
+        if (quantiles[p] == quantile) return &value[(size_t) p * numBins];
+    }
+    return nullptr;
+}
+
+AverageMode SpectrumAverager::getMode() const {
+    return mode;
+}
+
+uint64_t SpectrumAverager::getFrames() const {
+    return frames;
+}
+
+#endif
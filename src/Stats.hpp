@@ -0,0 +1,98 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+
+#define STATS_SUB_BUCKETS   8                       // per power of two, ~12% resolution
+#define STATS_BUCKETS       (STATS_SUB_BUCKETS*38)  // covers up to 2^40 ns
+
+typedef std::chrono::steady_clock::time_point TimePoint;
+
+// Latency histogram that any number of threads can record into without
+// locking. Buckets are log-linear: each power of two of nanoseconds is
+// split into STATS_SUB_BUCKETS equal parts, so percentiles come out within
+// one bucket width of the true value. Recording is a handful of relaxed
+// atomic adds, cheap enough for the audio callback.
+struct StageLatency {
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> totalNs{0};
+    std::atomic<uint64_t> maxNs{0};
+    std::atomic<uint64_t> buckets[STATS_BUCKETS] = {};
+
+    void record(TimePoint from, TimePoint to);
+    void recordNs(uint64_t ns);
+    double averageUs() const;
+    double percentileUs(double p) const;
+    void write(std::ostream &out, const char *name) const;
+
+    static uint32_t bucketFor(uint64_t ns);
+    static uint64_t bucketUpperNs(uint32_t bucket);
+};
+
+uint32_t StageLatency::bucketFor(uint64_t ns) {
+    if (ns < STATS_SUB_BUCKETS) return (uint32_t) ns;
+    uint32_t msb = 63 - __builtin_clzll(ns);
+    uint32_t sub = (uint32_t) (ns >> (msb - 3)) & (STATS_SUB_BUCKETS - 1);
+    uint32_t bucket = (msb - 2)*STATS_SUB_BUCKETS + sub;
+    return bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1;
+}
+
+uint64_t StageLatency::bucketUpperNs(uint32_t bucket) {
+    if (bucket < STATS_SUB_BUCKETS) return bucket + 1;
+    uint32_t msb = bucket/STATS_SUB_BUCKETS + 2;
+    uint64_t sub = bucket % STATS_SUB_BUCKETS;
+    return (STATS_SUB_BUCKETS + sub + 1) << (msb - 3);
+}
+
+void StageLatency::record(TimePoint from, TimePoint to) {
+    int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(to - from).count();
+    recordNs(ns > 0 ? (uint64_t) ns : 0);
+}
+
+void StageLatency::recordNs(uint64_t ns) {
+    count.fetch_add(1, std::memory_order_relaxed);
+    totalNs.fetch_add(ns, std::memory_order_relaxed);
+    buckets[bucketFor(ns)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t prev = maxNs.load(std::memory_order_relaxed);
+    while (ns > prev && !maxNs.compare_exchange_weak(prev, ns, std::memory_order_relaxed)) { }
+}
+
+double StageLatency::averageUs() const {
+    uint64_t n = count.load(std::memory_order_relaxed);
+    return n == 0 ? 0 : totalNs.load(std::memory_order_relaxed) / 1000.0 / n;
+}
+
+// Upper edge of the bucket holding the p-th percentile (p in [0, 1]),
+// clamped to the largest value seen. Concurrent records may be half
+// counted, which only matters for the last few samples.
+double StageLatency::percentileUs(double p) const {
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < STATS_BUCKETS; i++) total += buckets[i].load(std::memory_order_relaxed);
+    if (total == 0) return 0;
+
+    uint64_t rank = (uint64_t) (p*total);
+    if (rank >= total) rank = total - 1;
+    uint64_t seen = 0;
+    uint64_t max = maxNs.load(std::memory_order_relaxed);
+    for (uint32_t i = 0; i < STATS_BUCKETS; i++) {
+        seen += buckets[i].load(std::memory_order_relaxed);
+        if (seen > rank) {
+            uint64_t upper = bucketUpperNs(i);
+            return (upper < max ? upper : max) / 1000.0;
+        }
+    }
+    return max / 1000.0;
+}
+
+void StageLatency::write(std::ostream &out, const char *name) const {
+    out << std::setw(14) << name << ": avg " << std::fixed << std::setprecision(1)
+        << averageUs() << "  p50 " << percentileUs(0.5) << "  p99 " << percentileUs(0.99)
+        << "  max " << maxNs.load(std::memory_order_relaxed) / 1000.0 << " us  ("
+        << count.load(std::memory_order_relaxed) << ")" << std::endl;
+}
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef STATS_OVERLAY_H
+#define STATS_OVERLAY_H
+
+#include <SFML/Graphics.hpp>
+#include <cstdint>
+#include <string>
+
+// Block of monospace text on a translucent panel, drawn over whichever
+// view is active. The text is only rebuilt when setText is called, so the
+// caller decides how often the numbers refresh.
+class StatsOverlay {
+    public:
+        StatsOverlay(sf::RenderTarget *_window, sf::Vector2f _origin);
+        StatsOverlay(const StatsOverlay&) = delete;
+        void setText(const std::string &str);
+        void draw();
+    private:
+        sf::RenderTarget *window;
+        sf::Vector2f origin;
+        const float padding = 8;
+        const uint32_t fontSize = 12;
+        sf::Font font;
+        sf::Text text;
+        sf::RectangleShape background;
+};
+
+StatsOverlay::StatsOverlay(sf::RenderTarget *_window, sf::Vector2f _origin)
+    : window(_window),
+      origin(_origin),
+      text(font, "", fontSize)
+{
+    if(!font.openFromFile("/usr/share/fonts/liberation/LiberationMono-Regular.ttf")) {};
+    text.setFillColor(sf::Color::White);
+    text.setPosition(sf::Vector2f(origin.x + padding, origin.y + padding));
+    background.setFillColor(sf::Color(0, 0, 0, 180));
+    background.setPosition(origin);
+}
+
+void StatsOverlay::setText(const std::string &str) {
+    text.setString(str);
+    sf::FloatRect bounds = text.getLocalBounds();
+    background.setSize(sf::Vector2f(bounds.position.x + bounds.size.x + 2*padding,
+                                    bounds.position.y + bounds.size.y + 2*padding));
+}
+
+void StatsOverlay::draw() {
+    window->draw(background);
+    window->draw(text);
+}
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef WATERFALL_H
+#define WATERFALL_H
+
+#include <SFML/Graphics.hpp>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "FrequencyAxis.hpp"
+
+#define WATERFALL_MAX_ROWS  2048    // bins are peak-grouped down to this many texture rows
+#define COLORMAP_SIZE       256
+
+// Time-scrolling spectrogram. Each frame becomes one texture column written
+// at a wrapping index, and the texture is drawn as two quads split at that
+// index, so adding a frame costs O(bins) no matter how much history is
+// shown. Newest frames appear on the right, low frequencies at the bottom.
+class Waterfall {
+    public:
+        Waterfall(sf::RenderTarget *_window, uint32_t _fftSize, float _fundFreq,
+                  sf::Vector2f _origin, sf::Vector2f _size, sf::Vector2f _dBRange);
+        Waterfall(const Waterfall&) = delete;
+        void pushFrame(const float *dB);
+        void draw();
+        void setSize(sf::Vector2f _size);
+        void setDBRange(sf::Vector2f _dBRange);
+        void setAxis(const FrequencyAxis &_axis);
+    private:
+        void layout();
+        void buildAxis();
+        void buildColormap();
+        void updateQuads();
+
+        sf::RenderTarget *window;
+        uint32_t fftSize;
+        float fundFreq;
+        FrequencyAxis axis;     // linear FFT bins by default
+        sf::Vector2f origin;
+        sf::Vector2f size; // width, height
+        sf::Vector2f dBRange; // min, max
+        const float margin = 50;
+        const uint32_t numLabels = 5;
+        sf::Font font;
+
+        sf::Texture texture;
+        uint32_t columns, rows;
+        uint32_t writeColumn = 0;
+        std::vector<uint32_t> rowBegin, rowEnd;    // bins [begin, end) in each row
+        std::vector<uint8_t> columnPixels;
+        sf::VertexArray quads;
+        sf::Color colormap[COLORMAP_SIZE];
+        std::vector<sf::Text> labels;
+};
+
+Waterfall::Waterfall(sf::RenderTarget *_window, uint32_t _fftSize, float _fundFreq,
+                     sf::Vector2f _origin, sf::Vector2f _size, sf::Vector2f _dBRange)
+    : window(_window),
+      fftSize(_fftSize),
+      fundFreq(_fundFreq),
+      axis(FrequencyAxis::fft(_fftSize/2 + 1, _fundFreq, false)),
+      origin(_origin),
+      size(_size),
+      dBRange(_dBRange),
+      quads(sf::PrimitiveType::Triangles, 12)
+{
+    if(!font.openFromFile("/usr/share/fonts/liberation/LiberationMono-Regular.ttf")) {};
+    buildColormap();
+    layout();
+    buildAxis();
+}
+
+// Dark blue -> purple -> orange -> pale yellow, interpolated into a LUT
+void Waterfall::buildColormap() {
+    const sf::Color stops[] = {
+        sf::Color(0, 0, 4), sf::Color(40, 11, 84), sf::Color(101, 21, 110),
+        sf::Color(159, 42, 99), sf::Color(212, 72, 66), sf::Color(245, 125, 21),
+        sf::Color(250, 193, 39), sf::Color(252, 255, 164)
+    };
+    const uint32_t numStops = sizeof(stops)/sizeof(stops[0]);
+    for (uint32_t i = 0; i < COLORMAP_SIZE; i++) {
+        float pos = (float) i*(numStops - 1)/(COLORMAP_SIZE - 1);
+        uint32_t s = (uint32_t) pos < numStops - 1 ? (uint32_t) pos : numStops - 2;
+        float t = pos - s;
+        colormap[i] = sf::Color(
+            (uint8_t) (stops[s].r + t*(stops[s + 1].r - stops[s].r)),
+            (uint8_t) (stops[s].g + t*(stops[s + 1].g - stops[s].g)),
+            (uint8_t) (stops[s].b + t*(stops[s + 1].b - stops[s].b)));
+    }
+}
+
+void Waterfall::layout() {
+    uint32_t numBins = axis.numBins();
+    float plotWidth = size.x - 2*margin;
+    columns = plotWidth > 1 ? (uint32_t) plotWidth : 1;
+    rows = numBins <= WATERFALL_MAX_ROWS ? numBins : WATERFALL_MAX_ROWS;
+
+    axis.group(rows, rowBegin, rowEnd);
+    columnPixels.assign(rows*4, 0);
+
+    if (!texture.resize(sf::Vector2u(columns, rows))) {
+        std::cout << "Failed to create " << columns << "x" << rows << " waterfall texture" << std::endl;
+    }
+    // Start from the bottom color so empty history is not garbage
+    std::vector<uint8_t> blank(columns*rows*4);
+    for (size_t i = 0; i < blank.size(); i += 4) {
+        blank[i] = colormap[0].r;
+        blank[i + 1] = colormap[0].g;
+        blank[i + 2] = colormap[0].b;
+        blank[i + 3] = 255;
+    }
+    texture.update(blank.data());
+    writeColumn = 0;
+    updateQuads();
+}
+
+void Waterfall::buildAxis() {
+    const uint32_t fontSize = 14;
+    labels.clear();
+
+    float plotHeight = size.y - 2*margin;
+    for (uint32_t i = 0; i < numLabels; i++) {
+        float freq = axis.labelFrequency(i, numLabels);
+        std::stringstream ss;
+        ss << std::fixed << std::setprecision(1);
+        if (freq > 1000) {
+            ss << (freq / 1000) << " kHz";
+        } else {
+            ss << freq << " Hz";
+        }
+        sf::Text text(font, ss.str(), fontSize);
+        float ypos = origin.y + size.y - margin - axis.position(freq)*plotHeight - fontSize/2;
+        text.setPosition(sf::Vector2f({origin.x + 2, ypos}));
+        labels.push_back(text);
+    }
+}
+
+// Two textured quads: [writeColumn, columns) holds the oldest frames and
+// goes on the left, [0, writeColumn) the newest and goes on the right
+void Waterfall::updateQuads() {
+    float left = origin.x + margin;
+    float top = origin.y + margin;
+    float bottom = origin.y + size.y - margin;
+    float scaleX = (size.x - 2*margin)/columns;
+    float split = left + (columns - writeColumn)*scaleX;
+    float right = left + columns*scaleX;
+
+    auto setQuad = [this, top, bottom](size_t q, float x0, float x1, float u0, float u1) {
+        sf::Vertex *v = &quads[6*q];
+        v[0].position = sf::Vector2f(x0, top);    v[0].texCoords = sf::Vector2f(u0, 0);
+        v[1].position = sf::Vector2f(x1, top);    v[1].texCoords = sf::Vector2f(u1, 0);
+        v[2].position = sf::Vector2f(x0, bottom); v[2].texCoords = sf::Vector2f(u0, rows);
+        v[3].position = sf::Vector2f(x1, top);    v[3].texCoords = sf::Vector2f(u1, 0);
+        v[4].position = sf::Vector2f(x0, bottom); v[4].texCoords = sf::Vector2f(u0, rows);
+        v[5].position = sf::Vector2f(x1, bottom); v[5].texCoords = sf::Vector2f(u1, rows);
+    };
+    setQuad(0, left, split, writeColumn, columns);
+    setQuad(1, split, right, 0, writeColumn);
+}
+
+void Waterfall::pushFrame(const float *dB) {
+    float lutScale = (COLORMAP_SIZE - 1)/(dBRange.y - dBRange.x);
+    for (uint32_t r = 0; r < rows; r++) {
+        float value = dB[rowBegin[r]];
+        for (uint32_t b = rowBegin[r] + 1; b < rowEnd[r]; b++) {
+            if (dB[b] > value) value = dB[b];
+        }
+        float level = (value - dBRange.x)*lutScale;
+        if (level < 0) level = 0;                       // clamp to min
+        if (level > COLORMAP_SIZE - 1) level = COLORMAP_SIZE - 1; // clamp to max
+        const sf::Color &c = colormap[(uint32_t) level];
+
+        uint8_t *px = &columnPixels[4*(rows - 1 - r)]; // low frequencies at the bottom
+        px[0] = c.r;
+        px[1] = c.g;
+        px[2] = c.b;
+        px[3] = 255;
+    }
+
+    texture.update(columnPixels.data(), sf::Vector2u(1, rows), sf::Vector2u(writeColumn, 0));
+    writeColumn = (writeColumn + 1) % columns;
+    updateQuads();
+}
+
+void Waterfall::draw() {
+    window->draw(quads, sf::RenderStates(&texture));
+    for (const sf::Text &text : labels) window->draw(text);
+}
+
+void Waterfall::setSize(sf::Vector2f _size) {
+    size = _size;
+    layout();
+    buildAxis();
+}
+
+void Waterfall::setDBRange(sf::Vector2f _dBRange) {
+    dBRange = _dBRange;
+}
+
+// Clears the history, whose rows no longer line up with the new bins
+void Waterfall::setAxis(const FrequencyAxis &_axis) {
+    axis = _axis;
+    layout();
+    buildAxis();
+}
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef WORK_STEALING_POOL_H
+#define WORK_STEALING_POOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs a fixed batch of independent tasks on a set of threads. Tasks are
+// dealt round-robin into one deque per thread; each thread works from the
+// front of its own deque and, once that is empty, steals from the back of
+// the others, so uneven task sizes still keep every core busy. Submit the
+// largest tasks first: owners then start on big tasks and thieves pick up
+// the small ones left at the end.
+class WorkStealingPool {
+    public:
+        WorkStealingPool(uint32_t numThreads = 0);
+        WorkStealingPool(const WorkStealingPool&) = delete;
+        WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+        void submit(std::function<void()> task);
+        void run();
+
+        uint32_t getNumThreads() const;
+        uint64_t getSteals() const;
+    private:
+        struct Worker {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        bool next(uint32_t self, std::function<void()> &task);
+        void workerLoop(uint32_t self);
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        uint32_t nextWorker = 0;
+        std::atomic<uint64_t> steals{0};
+};
+
+WorkStealingPool::WorkStealingPool(uint32_t numThreads) {
+    if (numThreads == 0) numThreads = std::thread::hardware_concurrency();
+    if (numThreads == 0) numThreads = 1;
+    for (uint32_t i = 0; i < numThreads; i++) workers.push_back(std::make_unique<Worker>());
+}
+
+// Only between runs
+void WorkStealingPool::submit(std::function<void()> task) {
+    workers[nextWorker]->tasks.push_back(std::move(task));
+    nextWorker = (nextWorker + 1) % workers.size();
+}
+
+// Blocks until every submitted task has finished. Tasks do not submit more
+// work, so a thread is done once every deque is empty.
+void WorkStealingPool::run() {
+    std::vector<std::thread> threads;
+    for (uint32_t i = 1; i < workers.size(); i++) threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+    workerLoop(0);
+    for (std::thread &thread : threads) thread.join();
+    nextWorker = 0;
+}
+
+void WorkStealingPool::workerLoop(uint32_t self) {
+    std::function<void()> task;
+    while (next(self, task)) task();
+}
+
+bool WorkStealingPool::next(uint32_t self, std::function<void()> &task) {
+    {
+        Worker &own = *workers[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (uint32_t i = 1; i < workers.size(); i++) {
+        Worker &victim = *workers[(self + i) % workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            steals.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t WorkStealingPool::getNumThreads() const {
+    return workers.size();
+}
+
+uint64_t WorkStealingPool::getSteals() const {
+    return steals.load(std::memory_order_relaxed);
+}
+
+#endif
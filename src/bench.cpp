@@ -0,0 +1,943 @@
+#include <atomic>
+#include <chrono>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <complex>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fftw3.h>
+#include <SFML/Graphics.hpp>
+
+#include "Biquad.hpp"
+#include "CircularBuffer.hpp"
+#include "ConstantQ.hpp"
+#include "DBKernel.hpp"
+#include "Deinterleave.hpp"
+#include "FrameArena.hpp"
+#include "FramePool.hpp"
+#include "FrequencyAxis.hpp"
+#include "LPF.hpp"
+#include "Pipeline.hpp"
+#include "PlanRegistry.hpp"
+#include "Q15.hpp"
+#include "Resampler.hpp"
+#include "SPSCBuffer.hpp"
+#include "STFT.hpp"
+#include "SampleSource.hpp"
+#include "SlidingDFT.hpp"
+#include "Spectrogram.hpp"
+#include "SpectrumAverager.hpp"
+
+#define BENCH_MIN_SECONDS   0.2
+#define BENCH_SAMPLE_RATE   16000
+
+// --check tolerances; fast paths must stay inside these
+#define CHECK_DB            0.01    // filter responses and tone levels against analytic values
+#define CHECK_SDFT_DB       0.1     // sliding DFT against a full transform, damping costs ~0.05 dB
+#define CHECK_FLOOR_DB      -60     // levels below this are only checked to be small
+#define CHECK_Q15_SNR_DB    80      // LPFQ15 against the float LPF on a -6 dBFS tone, 84-93 dB as measured
+#define CHECK_CQ_DB         0.05    // constant-Q tone levels, kernel truncation costs ~0.01 dB
+#define CHECK_CQ_REJECT_DB  -40     // constant-Q response an octave away from a tone
+#define CHECK_QUANTILE_DB   1.0     // percentile estimates against the true quantile of 5 dB wide noise, ~4 sigma
+#define CHECK_SOURCE_FRAMES 256     // spectra a full-speed source has to get through, ~16 s of audio
+#define CHECK_SOURCE_SECONDS 10     // before its pipeline counts as stalled
+#define CHECK_ULPS          1024    // vectorized filters against the scalar path, in ulps of the signal's RMS;
+                                    // recursive filters amplify FMA contraction differences, a broken path is off by ~2^23
+
+using namespace std;
+
+// Keeps the compiler from discarding results that are otherwise unused
+template <typename T>
+void doNotOptimize(T const &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Runs `fn` until BENCH_MIN_SECONDS have passed and prints per-item cost.
+// `items` is the number of samples (or bins) one call processes.
+template <typename F>
+void bench(const string &name, uint64_t items, uint64_t bytes, F &&fn) {
+    fn(); // warm caches and lazy allocations
+
+    uint64_t iterations = 0;
+    double seconds = 0;
+    uint64_t batch = 1;
+    auto start = chrono::steady_clock::now();
+    while (seconds < BENCH_MIN_SECONDS) {
+        for (uint64_t i = 0; i < batch; i++) fn();
+        iterations += batch;
+        batch *= 2;
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+
+    double totalItems = (double) items * iterations;
+    cout << left << setw(44) << name << right << fixed
+         << setw(10) << setprecision(3) << seconds*1e9/totalItems << " ns/sample"
+         << setw(10) << setprecision(1) << totalItems/seconds/1e6 << " MS/s";
+    if (bytes > 0) {
+        cout << setw(10) << setprecision(1) << (double) bytes*iterations/seconds/1e9 << " GB/s";
+    }
+    cout << endl;
+}
+
+vector<float> noise(size_t n) {
+    vector<float> v(n);
+    for (float &x : v) x = (float) rand()/RAND_MAX - 0.5f;
+    return v;
+}
+
+void benchBuffers() {
+    const uint32_t blockSizes[] = {64, 512, 4096};
+    for (uint32_t block : blockSizes) {
+        vector<float> in = noise(block), out(block);
+        string suffix = "/" + to_string(block);
+
+        CircularBuffer<float> circ(4*block);
+        bench("CircularBuffer::write" + suffix, block, block*sizeof(float), [&]() {
+            for (uint32_t i = 0; i < block; i++) circ.write(in[i]);
+        });
+        bench("CircularBuffer::write(span)" + suffix, block, block*sizeof(float), [&]() {
+            circ.write(in);
+        });
+        bench("CircularBuffer::write+readBlock" + suffix, block, 2*block*sizeof(float), [&]() {
+            circ.write(in);
+            circ.readBlock(out.data(), block);
+            doNotOptimize(out[0]);
+        });
+        bench("CircularBuffer::write+peekLatest" + suffix, block, block*sizeof(float), [&]() {
+            circ.write(in);
+            SpanPair<const float> latest = circ.peekLatest(block);
+            doNotOptimize(latest.first[0]);
+        });
+
+        FrameArena arena;
+        CircularBuffer<float> borrowed(Span<float>(arena.allocate<float>(4*block), 4*block));
+        bench("CircularBuffer(arena)::write+peekLatest" + suffix, block, block*sizeof(float), [&]() {
+            borrowed.write(in);
+            SpanPair<const float> latest = borrowed.peekLatest(block);
+            doNotOptimize(latest.first[0]);
+        });
+
+        SPSCBuffer<float> spsc(4*block);
+        bench("SPSCBuffer::write+read" + suffix, block, 2*block*sizeof(float), [&]() {
+            spsc.write(in.data(), block);
+            spsc.read(out.data(), block);
+            doNotOptimize(out[0]);
+        });
+    }
+
+    FrameArena arena;
+    FramePool pool(arena, 16, 1024);
+    bench("FramePool::acquire+retain+release x2", 1, 0, [&]() {
+        SpectrumFrame *frame = pool.acquire();
+        pool.retain(frame);
+        pool.release(frame);
+        pool.release(frame);
+        doNotOptimize(frame);
+    });
+
+    const uint32_t channelCounts[] = {2, 8, 32};
+    const uint32_t frames = 512;
+    for (uint32_t channels : channelCounts) {
+        vector<float> in = noise(frames*channels), out(frames*channels);
+        vector<float*> planes(channels);
+        for (uint32_t c = 0; c < channels; c++) planes[c] = &out[c*frames];
+        bench("deinterleave " + to_string(channels) + "ch/" + to_string(frames), (uint64_t) frames*channels,
+              2*frames*channels*sizeof(float), [&]() {
+            deinterleave(in.data(), planes.data(), channels, frames);
+            doNotOptimize(out[0]);
+        });
+    }
+
+    for (uint32_t block : blockSizes) {
+        vector<float> in = noise(block), out(block);
+        vector<int16_t> q15(block);
+        string suffix = "/" + to_string(block);
+        bench("floatToQ15" + suffix, block, block*(sizeof(float) + sizeof(int16_t)), [&]() {
+            floatToQ15(in.data(), q15.data(), block);
+            doNotOptimize(q15[0]);
+        });
+        bench("q15ToFloat" + suffix, block, block*(sizeof(float) + sizeof(int16_t)), [&]() {
+            q15ToFloat(q15.data(), out.data(), block);
+            doNotOptimize(out[0]);
+        });
+    }
+}
+
+void benchFilters() {
+    const uint32_t blockSizes[] = {64, 512, 4096};
+    for (uint32_t block : blockSizes) {
+        vector<float> in = noise(block), out(block);
+        string suffix = "/" + to_string(block);
+
+        LPF lpf(BENCH_SAMPLE_RATE, 1000, 0.707f);
+        bench("LPF::process" + suffix, block, 0, [&]() {
+            for (uint32_t i = 0; i < block; i++) out[i] = lpf.process(in[i]);
+            doNotOptimize(out[block - 1]);
+        });
+
+        LPFQ15 lpf15(BENCH_SAMPLE_RATE, 1000, 0.707f);
+        vector<int16_t> in15(block), out15(block);
+        floatToQ15(in.data(), in15.data(), block);
+        bench("LPFQ15::processBlock" + suffix, block, 0, [&]() {
+            lpf15.processBlock(in15.data(), out15.data(), block);
+            doNotOptimize(out15[block - 1]);
+        });
+
+        Biquad biquad(BiquadType::LowPass, BENCH_SAMPLE_RATE, 1000, 0.707f);
+        bench("Biquad::processBlock" + suffix, block, 0, [&]() {
+            biquad.processBlock(in.data(), out.data(), block);
+            doNotOptimize(out[block - 1]);
+        });
+
+        BiquadCascade cascade;
+        for (uint32_t s = 0; s < 4; s++) {
+            cascade.addSection(BiquadCoeffs::design(BiquadType::Peak, BENCH_SAMPLE_RATE, 500.0f*(s + 1), 1, 3));
+        }
+        bench("BiquadCascade(4)::processBlock" + suffix, block, 0, [&]() {
+            cascade.processBlock(in.data(), out.data(), block);
+            doNotOptimize(out[block - 1]);
+        });
+    }
+
+    // Channel counts run as groups of BIQUAD_LANES interleaved channels
+    const uint32_t channelCounts[] = {8, 16, 32};
+    const uint32_t block = 512;
+    for (uint32_t channels : channelCounts) {
+        uint32_t groups = channels/BIQUAD_LANES;
+        vector<BiquadCascadeX8> banks;
+        banks.reserve(groups);
+        for (uint32_t g = 0; g < groups; g++) {
+            banks.emplace_back(4);
+            for (uint32_t s = 0; s < 4; s++)
+                for (uint32_t l = 0; l < BIQUAD_LANES; l++)
+                    banks[g].setSection(s, l, BiquadCoeffs::design(BiquadType::Peak, BENCH_SAMPLE_RATE, 300.0f*(s + 1) + 50*l, 1, 3));
+        }
+        vector<float> in = noise(block*BIQUAD_LANES), out(block*BIQUAD_LANES);
+        bench("BiquadCascadeX8(4) " + to_string(channels) + "ch/" + to_string(block), (uint64_t) block*channels, 0, [&]() {
+            for (BiquadCascadeX8 &bank : banks) bank.processBlock(in.data(), out.data(), block);
+            doNotOptimize(out[0]);
+        });
+    }
+
+    // Rates are input -> output; cost is per input sample
+    const uint32_t rates[][2] = {{48000, 16000}, {96000, 16000}, {44100, 16000}};
+    for (const uint32_t *rate : rates) {
+        PolyphaseResampler resampler(rate[0], rate[1]);
+        vector<float> in = noise(block), out(resampler.maxOutput(block));
+        bench("PolyphaseResampler " + to_string(rate[0]/1000) + "k->" + to_string(rate[1]/1000) + "k/" + to_string(block),
+              block, 0, [&]() {
+            resampler.process(in.data(), block, out.data());
+            doNotOptimize(out[0]);
+        });
+    }
+}
+
+void benchFFT(PlanRegistry &plans) {
+    const uint32_t fftSizes[] = {256, 1024, 4096, 8192};
+    for (uint32_t fftSize : fftSizes) {
+        uint32_t numBins = fftSize/2 + 1;
+        vector<float> in = noise(fftSize);
+        vector<float> dB(numBins);
+        STFT stft(plans, fftSize, fftSize/4, WindowType::Hann, 1);
+        string suffix = "/" + to_string(fftSize);
+
+        bench("STFT::analyze" + suffix, fftSize, 0, [&]() {
+            stft.analyze(in.data());
+        });
+        bench("spectrumToDB" + suffix, numBins, numBins*sizeof(fftwf_complex), [&]() {
+            spectrumToDB(stft.latestFrame(), dB.data(), numBins, amplitudeScale(fftSize));
+            doNotOptimize(dB[0]);
+        });
+        bench("STFT::analyze + spectrumToDB" + suffix, fftSize, 0, [&]() {
+            stft.analyze(in.data());
+            spectrumToDB(stft.latestFrame(), dB.data(), numBins, amplitudeScale(fftSize));
+            doNotOptimize(dB[0]);
+        });
+
+        const pair<const char*, const char*> averages[] = {{"exp", "exp:8"}, {"linear", "linear:16"},
+                                                           {"peak", "peak"}, {"p95", "p95"}};
+        for (const pair<const char*, const char*> &average : averages) {
+            AverageSpec spec;
+            parseAverage(average.second, spec);
+            SpectrumAverager averager(numBins, spec.mode, spec.param);
+            averager.add(dB.data());
+            bench("SpectrumAverager " + string(average.first) + suffix, numBins, 0, [&]() {
+                averager.add(dB.data());
+                doNotOptimize(averager);
+            });
+        }
+
+        // Per hop of new samples, to compare against one analyze() above
+        uint32_t hop = fftSize/4;
+        for (uint32_t numTracked : {8u, 32u}) {
+            vector<uint32_t> bins;
+            for (uint32_t i = 0; i < numTracked; i++) bins.push_back(1 + i*(numBins - 2)/numTracked);
+            SlidingDFT sdft(fftSize, bins, WindowType::Hann);
+            bench("SlidingDFT::process " + to_string(numTracked) + " bins" + suffix, hop, 0, [&]() {
+                sdft.process(in.data(), hop, hop, dB.data());
+                doNotOptimize(dB[0]);
+            });
+        }
+    }
+}
+
+// Per frame of hop-size new samples at the default constant-Q settings
+void benchConstantQ(PlanRegistry &plans) {
+    for (uint32_t binsPerOctave : {12u, 24u}) {
+        ConstantQ cq(plans, BENCH_SAMPLE_RATE, CQ_MIN_FREQ, binsPerOctave);
+        uint32_t fftSize = cq.getFFTSize();
+        vector<float> in = noise(fftSize);
+        vector<float> dB(cq.getNumBins());
+        STFT stft(plans, fftSize, fftSize, WindowType::Rectangular, 1);
+        stft.analyze(in.data());
+        string suffix = "/" + to_string(binsPerOctave) + " per octave";
+
+        bench("ConstantQ::apply" + suffix, cq.getNumBins(), (uint64_t) cq.getKernelTaps()*2*sizeof(fftwf_complex), [&]() {
+            cq.apply(stft.latestFrame(), dB.data());
+            doNotOptimize(dB[0]);
+        });
+        bench("ConstantQ::analyze" + suffix, fftSize, 0, [&]() {
+            cq.analyze(in.data(), dB.data());
+            doNotOptimize(dB[0]);
+        });
+    }
+}
+
+void benchRender(PlanRegistry &plans) {
+    sf::RenderTexture target;
+    if (!target.resize(sf::Vector2u(1280, 800))) {
+        cout << "Skipping render benchmarks, no offscreen target" << endl;
+        return;
+    }
+
+    const uint32_t fftSizes[] = {1024, 8192};
+    for (uint32_t fftSize : fftSizes) {
+        STFT stft(plans, fftSize, fftSize/4, WindowType::Hann, 1);
+        vector<float> in = noise(fftSize);
+        stft.analyze(in.data());
+        Spectrogram spectrogram(&target, stft.latestFrame(), fftSize, BENCH_SAMPLE_RATE/fftSize,
+                                sf::Vector2f(0, 0), sf::Vector2f(1280, 800), sf::Vector2f(-80, 0));
+        bench("Spectrogram::drawBars/" + to_string(fftSize), fftSize/2 + 1, 0, [&]() {
+            spectrogram.drawBars();
+        });
+    }
+}
+
+// Accuracy checks, run with --check instead of the benchmarks. Each group
+// prints how many of its checks failed and the first few failures, and the
+// exit status is nonzero if any did.
+
+uint32_t checksRun = 0, checksFailed = 0;
+
+bool expect(bool ok, const string &what) {
+    checksRun++;
+    if (!ok && checksFailed++ < 20) cout << "  FAIL " << what << endl;
+    return ok;
+}
+
+bool expectDB(double actual, double expected, double tolerance, const string &what) {
+    if (expected < CHECK_FLOOR_DB) return expect(actual < CHECK_FLOOR_DB + tolerance, what + ": " + to_string(actual) + " dB, expected below " + to_string(CHECK_FLOOR_DB));
+    return expect(fabs(actual - expected) <= tolerance, what + ": " + to_string(actual) + " dB, expected " + to_string(expected));
+}
+
+void report(const string &group, uint32_t runBefore, uint32_t failedBefore) {
+    cout << left << setw(44) << group << right << setw(8) << checksRun - runBefore << " checks"
+         << setw(8) << checksFailed - failedBefore << " failed" << endl;
+}
+
+// Largest difference between two runs of a filter, in units of the float
+// spacing at the reference's RMS level. Plain ulps blow up near zero
+// crossings, where any reordering of the arithmetic changes low bits.
+// `actual` may be one lane of interleaved data, `stride` floats apart.
+double ulpsAtRMS(const float *expected, const float *actual, uint32_t n, uint32_t stride = 1) {
+    double power = 0, worst = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        power += (double) expected[i]*expected[i];
+        worst = max(worst, fabs((double) expected[i] - actual[i*stride]));
+    }
+    double rms = sqrt(power/n);
+    return rms > 0 ? worst/(rms*FLT_EPSILON) : worst;
+}
+
+// |H(e^jw)| in dB straight from the difference equation coefficients
+double responseDB(const BiquadCoeffs &c, double freq, uint32_t fs) {
+    complex<double> z1 = polar(1.0, -2*M_PI*freq/fs);
+    complex<double> num = (double) c.b0 + z1*((double) c.b1 + z1*(double) c.b2);
+    complex<double> den = 1.0 + z1*((double) c.a1 + z1*(double) c.a2);
+    complex<double> h = num/den;
+    return 20*log10(max(abs(h), 1e-12));
+}
+
+// Gain of a filtered tone, from the ratio of output to input power over a
+// whole number of periods after the transient has died down
+double measureDB(const vector<float> &in, const vector<float> &out, uint32_t from) {
+    double inPower = 0, outPower = 0;
+    for (size_t i = from; i < in.size(); i++) {
+        inPower += (double) in[i]*in[i];
+        outPower += (double) out[i]*out[i];
+    }
+    return 10*log10(max(outPower/inPower, 1e-24));
+}
+
+void checkFilters() {
+    uint32_t runBefore = checksRun, failedBefore = checksFailed;
+    const uint32_t fs = BENCH_SAMPLE_RATE;
+    const float freqs[] = {100, 1000, 4000};
+    const float qs[] = {0.5f, 0.7071f, 2};
+    const float gains[] = {6, -12};
+
+    // Values every RBJ design has to hit exactly in the analog prototype,
+    // which the prewarped bilinear transform keeps at DC, f0 and Nyquist
+    for (float f0 : freqs) {
+        for (float q : qs) {
+            string tag = " f0=" + to_string((int) f0) + " q=" + to_string(q);
+            double qDB = 20*log10(q);
+            BiquadCoeffs c = BiquadCoeffs::design(BiquadType::LowPass, fs, f0, q);
+            expectDB(responseDB(c, 0, fs), 0, CHECK_DB, "lowpass DC" + tag);
+            expectDB(responseDB(c, f0, fs), qDB, CHECK_DB, "lowpass f0" + tag);
+            expectDB(responseDB(c, fs/2.0, fs), -INFINITY, CHECK_DB, "lowpass Nyquist" + tag);
+            c = BiquadCoeffs::design(BiquadType::HighPass, fs, f0, q);
+            expectDB(responseDB(c, 0, fs), -INFINITY, CHECK_DB, "highpass DC" + tag);
+            expectDB(responseDB(c, f0, fs), qDB, CHECK_DB, "highpass f0" + tag);
+            expectDB(responseDB(c, fs/2.0, fs), 0, CHECK_DB, "highpass Nyquist" + tag);
+            c = BiquadCoeffs::design(BiquadType::BandPass, fs, f0, q);
+            expectDB(responseDB(c, f0, fs), 0, CHECK_DB, "bandpass f0" + tag);
+            expectDB(responseDB(c, 0, fs), -INFINITY, CHECK_DB, "bandpass DC" + tag);
+            c = BiquadCoeffs::design(BiquadType::Notch, fs, f0, q);
+            expectDB(responseDB(c, f0, fs), -INFINITY, CHECK_DB, "notch f0" + tag);
+            expectDB(responseDB(c, 0, fs), 0, CHECK_DB, "notch DC" + tag);
+            for (float gain : gains) {
+                string gtag = tag + " gain=" + to_string((int) gain);
+                c = BiquadCoeffs::design(BiquadType::Peak, fs, f0, q, gain);
+                expectDB(responseDB(c, f0, fs), gain, CHECK_DB, "peak f0" + gtag);
+                expectDB(responseDB(c, 0, fs), 0, CHECK_DB, "peak DC" + gtag);
+                c = BiquadCoeffs::design(BiquadType::LowShelf, fs, f0, q, gain);
+                expectDB(responseDB(c, 0, fs), gain, CHECK_DB, "lowshelf DC" + gtag);
+                expectDB(responseDB(c, fs/2.0, fs), 0, CHECK_DB, "lowshelf Nyquist" + gtag);
+                c = BiquadCoeffs::design(BiquadType::HighShelf, fs, f0, q, gain);
+                expectDB(responseDB(c, 0, fs), 0, CHECK_DB, "highshelf DC" + gtag);
+                expectDB(responseDB(c, fs/2.0, fs), gain, CHECK_DB, "highshelf Nyquist" + gtag);
+            }
+        }
+    }
+
+    // LPF is a named low-pass Biquad
+    LPF lpf(fs, 1000, 0.7071f);
+    BiquadCoeffs lc = lpf.getCoeffs(), bc = BiquadCoeffs::design(BiquadType::LowPass, fs, 1000, 0.7071f);
+    expect(memcmp(&lc, &bc, sizeof(BiquadCoeffs)) == 0, "LPF coefficients differ from BiquadCoeffs::design");
+
+    // Tones through the per-sample, block and cascade paths against H(z)
+    const uint32_t length = 8*fs/10, settle = fs/10;
+    for (float toneFreq : {50.0f, 400.0f, 1000.0f, 2500.0f, 6000.0f}) {
+        vector<float> in(length), out(length), out2(length);
+        for (uint32_t i = 0; i < length; i++) in[i] = (float) sin(2*M_PI*toneFreq*i/fs);
+        for (BiquadType type : {BiquadType::LowPass, BiquadType::HighPass, BiquadType::Peak}) {
+            BiquadCoeffs c = BiquadCoeffs::design(type, fs, 1000, 0.7071f, 6);
+            string tag = " type=" + to_string((int) type) + " tone=" + to_string((int) toneFreq);
+            double expected = responseDB(c, toneFreq, fs);
+            Biquad single(c);
+            for (uint32_t i = 0; i < length; i++) out[i] = single.process(in[i]);
+            expectDB(measureDB(in, out, settle), expected, CHECK_DB, "Biquad::process" + tag);
+            Biquad block(c);
+            block.processBlock(in.data(), out2.data(), length);
+            double worst = ulpsAtRMS(out.data(), out2.data(), length);
+            expect(worst <= CHECK_ULPS, "Biquad::processBlock vs process" + tag + ": " + to_string(worst) + " ulps");
+        }
+
+        BiquadCoeffs sections[2] = {BiquadCoeffs::design(BiquadType::LowPass, fs, 3000, 0.7071f),
+                                    BiquadCoeffs::design(BiquadType::HighPass, fs, 100, 0.7071f)};
+        BiquadCascade cascade;
+        for (const BiquadCoeffs &c : sections) cascade.addSection(c);
+        cascade.processBlock(in.data(), out.data(), length);
+        expectDB(measureDB(in, out, settle), responseDB(sections[0], toneFreq, fs) + responseDB(sections[1], toneFreq, fs),
+                 CHECK_DB, "BiquadCascade tone=" + to_string((int) toneFreq));
+    }
+
+    // Each SIMD lane of the 8-wide cascade against the scalar cascade
+    const uint32_t frames = 4096;
+    vector<float> lanes = noise(frames*BIQUAD_LANES), lanesOut(frames*BIQUAD_LANES);
+    BiquadCascadeX8 bank(2);
+    vector<BiquadCascade> scalar(BIQUAD_LANES);
+    for (uint32_t l = 0; l < BIQUAD_LANES; l++) {
+        BiquadCoeffs a = BiquadCoeffs::design(BiquadType::Peak, fs, 200.0f + 300*l, 1.5f, -6);
+        BiquadCoeffs b = BiquadCoeffs::design(BiquadType::LowPass, fs, 1000.0f + 500*l, 0.7071f);
+        bank.setSection(0, l, a);
+        bank.setSection(1, l, b);
+        scalar[l].addSection(a);
+        scalar[l].addSection(b);
+    }
+    bank.processBlock(lanes.data(), lanesOut.data(), frames);
+    for (uint32_t l = 0; l < BIQUAD_LANES; l++) {
+        vector<float> mono(frames);
+        for (uint32_t i = 0; i < frames; i++) mono[i] = lanes[i*BIQUAD_LANES + l];
+        scalar[l].processBlock(mono.data(), mono.data(), frames);
+        double worst = ulpsAtRMS(mono.data(), &lanesOut[l], frames, BIQUAD_LANES);
+        expect(worst <= CHECK_ULPS, "BiquadCascadeX8 lane " + to_string(l) + ": " + to_string(worst) + " ulps");
+    }
+    report("filters", runBefore, failedBefore);
+}
+
+void checkQ15() {
+    uint32_t runBefore = checksRun, failedBefore = checksFailed;
+
+    // Every int16 value survives a trip through float, and sizes that end
+    // in a scalar tail match the vector body
+    for (uint32_t n : {1u, 7u, 15u, 16u, 17u, 65535u, 65536u}) {
+        vector<int16_t> in(n), back(n);
+        vector<float> f(n);
+        for (uint32_t i = 0; i < n; i++) in[i] = (int16_t) (i*7919 + INT16_MIN);
+        q15ToFloat(in.data(), f.data(), n);
+        floatToQ15(f.data(), back.data(), n);
+        bool exact = true, scaled = true;
+        for (uint32_t i = 0; i < n; i++) {
+            exact = exact && back[i] == in[i];
+            scaled = scaled && f[i] == in[i]/Q15_SCALE;
+        }
+        expect(scaled, "q15ToFloat scale n=" + to_string(n));
+        expect(exact, "Q15 round trip n=" + to_string(n));
+    }
+
+    // Rounding and saturation against the scalar definition
+    vector<float> f = {0.0f, 0.5f/Q15_SCALE, 1.4f/Q15_SCALE, -1.6f/Q15_SCALE, 1.0f, -1.0f, 2.0f, -2.0f,
+                       1e30f, -1e30f, 0.999f, -0.999f, 0.25f, -0.25f, 3.0f/Q15_SCALE, 1.0f - 0.5f/Q15_SCALE, 0.1f};
+    vector<int16_t> q(f.size());
+    floatToQ15(f.data(), q.data(), f.size());
+    for (size_t i = 0; i < f.size(); i++) {
+        float x = fmin(fmax(f[i]*Q15_SCALE, -Q15_SCALE), Q15_SCALE - 1);
+        expect(q[i] == (int16_t) nearbyint(x), "floatToQ15(" + to_string(f[i]) + ") = " + to_string(q[i]));
+    }
+
+    // LPFQ15 against the float LPF it is designed from
+    const uint32_t fs = BENCH_SAMPLE_RATE, length = 8*fs/10, settle = fs/10;
+    for (uint32_t cutoff : {100u, 1000u, 4000u}) {
+        for (float toneFreq : {50.0f, 400.0f, 1000.0f, 2500.0f}) {
+            vector<float> in(length), ref(length), out(length);
+            vector<int16_t> in15(length), out15(length);
+            for (uint32_t i = 0; i < length; i++) in[i] = 0.5f*(float) sin(2*M_PI*toneFreq*i/fs);
+            floatToQ15(in.data(), in15.data(), length);
+            q15ToFloat(in15.data(), in.data(), length);
+
+            LPF lpf(fs, cutoff, 0.7071f);
+            LPFQ15 lpf15(fs, cutoff, 0.7071f);
+            for (uint32_t i = 0; i < length; i++) ref[i] = lpf.process(in[i]);
+            lpf15.processBlock(in15.data(), out15.data(), length);
+            q15ToFloat(out15.data(), out.data(), length);
+
+            string tag = " cutoff=" + to_string(cutoff) + " tone=" + to_string((int) toneFreq);
+            double signal = 0, error = 0;
+            for (uint32_t i = settle; i < length; i++) {
+                signal += (double) in[i]*in[i];
+                error += ((double) out[i] - ref[i])*((double) out[i] - ref[i]);
+            }
+            double snr = 10*log10(signal/max(error, 1e-30));
+            expect(snr >= CHECK_Q15_SNR_DB, "LPFQ15 vs LPF" + tag + ": " + to_string(snr) + " dB");
+        }
+    }
+
+    // A full scale step overshoots a resonant low-pass by ~60%, which has
+    // to clip rather than wrap negative
+    LPFQ15 resonant(fs, 1000, 4);
+    int16_t lowest = INT16_MAX, highest = 0;
+    for (uint32_t i = 0; i < fs/10; i++) {
+        int16_t y = resonant.process(INT16_MAX);
+        lowest = min(lowest, y);
+        highest = max(highest, y);
+    }
+    expect(lowest >= 0 && highest == INT16_MAX, "LPFQ15 step saturates: " + to_string(lowest) + ".." + to_string(highest));
+    report("Q15", runBefore, failedBefore);
+}
+
+void checkArena() {
+    uint32_t runBefore = checksRun, failedBefore = checksFailed;
+
+    // Every allocation aligned, zeroed and disjoint, including ones larger
+    // than a chunk
+    FrameArena arena(false, 4096);
+    vector<pair<uint8_t*, size_t>> blocks;
+    for (size_t bytes : {1, 63, 64, 65, 1000, 4096, 5000, 3, 100000, 17}) {
+        uint8_t *p = (uint8_t*) arena.allocateBytes(bytes);
+        bool zero = true;
+        for (size_t i = 0; i < bytes; i++) zero = zero && p[i] == 0;
+        expect(p != nullptr && (uintptr_t) p % ARENA_ALIGN == 0, "arena alignment bytes=" + to_string(bytes));
+        expect(zero, "arena zeroed bytes=" + to_string(bytes));
+        memset(p, 0xff, bytes);
+        blocks.push_back({p, bytes});
+    }
+    bool disjoint = true;
+    for (size_t i = 0; i < blocks.size(); i++)
+        for (size_t j = 0; j < i; j++)
+            disjoint = disjoint && (blocks[i].first >= blocks[j].first + blocks[j].second || blocks[j].first >= blocks[i].first + blocks[i].second);
+    expect(disjoint, "arena allocations overlap");
+    expect(arena.getUsed() <= arena.getReserved(), "arena used <= reserved");
+
+    // Frames recycle only after their last reference goes
+    FramePool pool(arena, 4, 256);
+    vector<SpectrumFrame*> held;
+    for (uint32_t i = 0; i < 4; i++) held.push_back(pool.acquire());
+    expect(pool.acquire() == nullptr, "pool exhausted after 4 acquires");
+    for (SpectrumFrame *frame : held) {
+        expect(frame != nullptr && (uintptr_t) frame->samples % ARENA_ALIGN == 0 && (uintptr_t) frame->spectrum % ARENA_ALIGN == 0,
+               "pool frame buffers aligned");
+    }
+    pool.retain(held[0]);
+    pool.release(held[0]);
+    expect(pool.available() == 0, "retained frame stays out of the pool");
+    pool.release(held[0]);
+    expect(pool.available() == 1 && pool.acquire() == held[0], "frame returns after its last release");
+    report("FrameArena", runBefore, failedBefore);
+}
+
+// Tone levels with the display's 20*log10(2|X|/fftSize) scaling
+void checkSpectrum(PlanRegistry &plans) {
+    uint32_t runBefore = checksRun, failedBefore = checksFailed;
+
+    // spectrumToDB's polynomial log against the exact one
+    const uint32_t numBins = 1025;
+    vector<fftwf_complex> dft(numBins);
+    vector<float> dB(numBins);
+    mt19937 rng(1);
+    uniform_real_distribution<float> exponent(-6, 3);
+    for (uint32_t i = 0; i < numBins; i++) {
+        dft[i][0] = pow(10.0f, exponent(rng));
+        dft[i][1] = pow(10.0f, exponent(rng));
+    }
+    spectrumToDB(dft.data(), dB.data(), numBins, 1);
+    for (uint32_t i = 0; i < numBins; i++) {
+        double power = (double) dft[i][0]*dft[i][0] + (double) dft[i][1]*dft[i][1];
+        expectDB(dB[i], 10*log10(power), CHECK_DB, "spectrumToDB bin " + to_string(i));
+    }
+
+    for (uint32_t fftSize : {256u, 1024u, 4096u}) {
+        for (WindowType windowType : {WindowType::Rectangular, WindowType::Hann, WindowType::Blackman}) {
+            STFT stft(plans, fftSize, fftSize, windowType, 1);
+            vector<float> window(fftSize), in(fftSize), levels(fftSize/2 + 1);
+            STFT::computeWindow(windowType, 8.6f, window.data(), fftSize);
+            double gain = 0;
+            for (float w : window) gain += w;
+            gain /= fftSize;
+
+            for (uint32_t bin : {fftSize/16, fftSize/4 + 3, fftSize/2 - 20}) {
+                for (float amplitude : {1.0f, 0.01f}) {
+                    for (uint32_t i = 0; i < fftSize; i++) in[i] = amplitude*(float) cos(2*M_PI*bin*i/fftSize);
+                    stft.analyze(in.data());
+                    spectrumToDB(stft.latestFrame(), levels.data(), fftSize/2 + 1, amplitudeScale(fftSize));
+                    string tag = " fft=" + to_string(fftSize) + " window=" + to_string((int) windowType)
+                               + " bin=" + to_string(bin) + " amplitude=" + to_string(amplitude);
+                    expectDB(levels[bin], 20*log10(amplitude*gain), CHECK_DB, "tone level" + tag);
+                    if (windowType == WindowType::Rectangular) {
+                        expectDB(levels[bin + 5], -INFINITY, CHECK_DB, "rectangular leakage" + tag);
+                    }
+                }
+            }
+        }
+    }
+
+    // Sliding DFT bins against the full transform of the same window, on
+    // tones so every checked level is well above the rounding noise
+    const uint32_t fftSize = 1024;
+    vector<float> in(8*fftSize);
+    for (uint32_t i = 0; i < in.size(); i++) {
+        in[i] = 0.5f*(float) sin(2*M_PI*100.25*i/fftSize) + 0.05f*(float) sin(2*M_PI*300*i/fftSize)
+              + 0.01f*(float) cos(2*M_PI*50*i/fftSize);
+    }
+    vector<uint32_t> bins = {50, 100, 101, 300, 301};
+    for (WindowType windowType : {WindowType::Rectangular, WindowType::Hann}) {
+        SlidingDFT sdft(fftSize, bins, windowType);
+        sdft.update(in.data(), in.size());
+        vector<float> tracked(bins.size()), full(fftSize/2 + 1);
+        sdft.levels(tracked.data());
+        STFT stft(plans, fftSize, fftSize, windowType, 1);
+        stft.analyze(&in[in.size() - fftSize]);
+        spectrumToDB(stft.latestFrame(), full.data(), fftSize/2 + 1, amplitudeScale(fftSize));
+        for (uint32_t i = 0; i < bins.size(); i++) {
+            expectDB(tracked[i], full[bins[i]], CHECK_SDFT_DB,
+                     "SlidingDFT bin " + to_string(bins[i]) + " window=" + to_string((int) windowType));
+        }
+    }
+    // every = 0 emits a row per sample rather than never again
+    SlidingDFT sdft(fftSize, bins);
+    vector<float> rows(17*bins.size());
+    expect(sdft.process(in.data(), 16, 0, rows.data()) == 16, "SlidingDFT::process every=0");
+    report("spectrum", runBefore, failedBefore);
+}
+
+// Constant-Q levels of tones on bin centres against their amplitude, and
+// display axes mapping every slot onto real bins
+void checkConstantQ(PlanRegistry &plans) {
+    uint32_t runBefore = checksRun, failedBefore = checksFailed;
+
+    for (uint32_t binsPerOctave : {12u, 24u}) {
+        ConstantQ cq(plans, BENCH_SAMPLE_RATE, CQ_MIN_FREQ, binsPerOctave);
+        uint32_t fftSize = cq.getFFTSize(), numBins = cq.getNumBins();
+        expect(fftSize == ConstantQ::fftSizeFor(BENCH_SAMPLE_RATE, CQ_MIN_FREQ, binsPerOctave), "constant-Q fft size");
+        expect(numBins > 6*binsPerOctave && cq.getFrequency(numBins - 1) < BENCH_SAMPLE_RATE/2, "constant-Q bin count");
+
+        vector<float> in(fftSize), levels(numBins);
+        for (uint32_t bin : {0u, binsPerOctave + 1, numBins/2, numBins - 1}) {
+            for (float amplitude : {0.5f, 0.01f}) {
+                double freq = cq.getFrequency(bin);
+                for (uint32_t i = 0; i < fftSize; i++) in[i] = amplitude*(float) sin(2*M_PI*freq*i/BENCH_SAMPLE_RATE + 0.3);
+                cq.analyze(in.data(), levels.data());
+                string tag = " per octave=" + to_string(binsPerOctave) + " bin=" + to_string(bin)
+                           + " amplitude=" + to_string(amplitude);
+                expectDB(levels[bin], 20*log10(amplitude), CHECK_CQ_DB, "constant-Q tone level" + tag);
+                uint32_t peak = 0;
+                for (uint32_t b = 1; b < numBins; b++) if (levels[b] > levels[peak]) peak = b;
+                expect(peak == bin, "constant-Q peak bin" + tag);
+                for (int32_t away : {-(int32_t) binsPerOctave, (int32_t) binsPerOctave}) {
+                    int32_t b = (int32_t) bin + away;
+                    if (b < 0 || b >= (int32_t) numBins) continue;
+                    expect(levels[b] < 20*log10(amplitude) + CHECK_CQ_REJECT_DB, "constant-Q octave rejection" + tag);
+                }
+            }
+        }
+    }
+
+    ConstantQ cq(plans, BENCH_SAMPLE_RATE, CQ_MIN_FREQ);
+    const FrequencyAxis axes[] = {FrequencyAxis::fft(513, BENCH_SAMPLE_RATE/1024.0f, false),
+                                  FrequencyAxis::fft(513, BENCH_SAMPLE_RATE/1024.0f, true),
+                                  cq.axis(), FrequencyAxis::bins(vector<float>{100, 200, 400}, true)};
+    for (const FrequencyAxis &axis : axes) {
+        for (uint32_t slots : {1u, 7u, 86u, 500u, 2048u}) {
+            vector<uint32_t> begin, end;
+            axis.group(slots, begin, end);
+            bool valid = begin.size() == slots && end.size() == slots;
+            for (uint32_t s = 0; valid && s < slots; s++) {
+                valid = begin[s] < end[s] && end[s] <= axis.numBins() && (s == 0 || begin[s] >= begin[s - 1]);
+            }
+            string tag = " log=" + to_string(axis.logScale) + " bins=" + to_string(axis.numBins()) + " slots=" + to_string(slots);
+            expect(valid, "FrequencyAxis groups" + tag);
+            expect(fabs(axis.position(axis.frequencyAt(0.3f)) - 0.3f) < 1e-4f, "FrequencyAxis round trip" + tag);
+        }
+    }
+    report("ConstantQ", runBefore, failedBefore);
+}
+
+// Every mode against a plain scalar model on random spectra, and the
+// percentile estimates against the known quantiles of Gaussian levels
+void checkAverages() {
+    uint32_t runBefore = checksRun, failedBefore = checksFailed;
+    const uint32_t numBins = 37;    // not a multiple of the vector width
+    mt19937 rng(3);
+    normal_distribution<float> level(-50, 5);
+    vector<float> dB(numBins), out(numBins);
+
+    for (const char *name : {"exp:8", "linear:5", "peak:0.5"}) {
+        AverageSpec spec;
+        parseAverage(name, spec);
+        SpectrumAverager averager(numBins, spec.mode, spec.param);
+        vector<double> model(numBins);
+        deque<vector<float>> recent;
+        for (uint32_t frame = 0; frame < 200; frame++) {
+            for (float &x : dB) x = level(rng);
+            averager.add(dB.data());
+            recent.push_back(dB);
+            if (recent.size() > spec.param) recent.pop_front();
+            for (uint32_t i = 0; i < numBins; i++) {
+                if (frame == 0) model[i] = dB[i];
+                else if (spec.mode == AverageMode::Exponential) model[i] += (dB[i] - model[i])/spec.param;
+                else if (spec.mode == AverageMode::PeakHold) model[i] = max((double) dB[i], model[i] - spec.param);
+                else {
+                    model[i] = 0;
+                    for (const vector<float> &row : recent) model[i] += row[i];
+                    model[i] /= recent.size();
+                }
+            }
+            averager.read(out.data());
+            for (uint32_t i = 0; i < numBins; i++) {
+                expectDB(out[i], model[i], CHECK_DB, string(name) + " frame " + to_string(frame) + " bin " + to_string(i));
+            }
+        }
+    }
+
+    // Each bin its own mean, so a mixed-up bin would show
+    SpectrumAverager averager(numBins, AverageMode::Percentile, 0.95f);
+    for (uint32_t frame = 0; frame < 20000; frame++) {
+        for (uint32_t i = 0; i < numBins; i++) dB[i] = level(rng) - i;
+        averager.add(dB.data());
+    }
+    averager.read(out.data());
+    for (uint32_t i = 0; i < numBins; i++) {
+        expectDB(out[i], -50.0 - i + 1.645*5, CHECK_QUANTILE_DB, "P95 bin " + to_string(i));
+    }
+    expectDB(averager.floorDB(0.5f), -50.0 - numBins/2, CHECK_QUANTILE_DB, "P50 floor");
+    report("averages", runBefore, failedBefore);
+}
+
+// Randomized operations against a deque holding what the buffer should
+void checkBuffers() {
+    uint32_t runBefore = checksRun, failedBefore = checksFailed;
+    mt19937 rng(2);
+    for (uint32_t capacity : {1u, 7u, 8u, 64u, 1000u}) {
+        CircularBuffer<uint32_t> buf(capacity);
+        deque<uint32_t> model;
+        uint32_t next = 0;
+        string tag = " capacity=" + to_string(capacity);
+        for (uint32_t step = 0; step < 20000; step++) {
+            uint32_t n = rng() % (2*capacity + 2);
+            vector<uint32_t> block(n + 1);
+            switch (rng() % 8) {
+                case 0: {
+                    for (uint32_t i = 0; i < n; i++) block[i] = next++;
+                    uint32_t lost = buf.write(Span<const uint32_t>(block.data(), n));
+                    uint32_t expectedLost = 0;
+                    for (uint32_t i = 0; i < n; i++) model.push_back(block[i]);
+                    while (model.size() > capacity) {
+                        model.pop_front();
+                        expectedLost++;
+                    }
+                    expect(lost == expectedLost, "write(span) lost count" + tag);
+                    break;
+                }
+                case 1: {
+                    uint32_t got = buf.readBlock(block.data(), n);
+                    bool same = got == min<size_t>(n, model.size());
+                    for (uint32_t i = 0; same && i < got; i++) same = block[i] == model[i];
+                    for (uint32_t i = 0; i < got && !model.empty(); i++) model.pop_front();
+                    expect(same, "readBlock order" + tag);
+                    break;
+                }
+                case 2: {
+                    SpanPair<const uint32_t> view = buf.peekLatest(n);
+                    bool same = n == 0 || n > model.size() ? view.empty() : view.size() == n;
+                    if (same && !view.empty()) {
+                        view.copyTo(block.data());
+                        for (uint32_t i = 0; same && i < n; i++) same = block[i] == model[model.size() - n + i];
+                    }
+                    expect(same, "peekLatest" + tag);
+                    break;
+                }
+                case 3: {
+                    uint32_t got = buf.consume(n);
+                    expect(got == min<size_t>(n, model.size()), "consume count" + tag);
+                    for (uint32_t i = 0; i < got; i++) model.pop_front();
+                    break;
+                }
+                case 4: {
+                    SpanPair<const uint32_t> view = buf.peek(n);
+                    bool same = view.size() == min<size_t>(n, model.size());
+                    view.copyTo(block.data());
+                    for (uint32_t i = 0; same && i < view.size(); i++) same = block[i] == model[i];
+                    expect(same, "peek" + tag);
+                    break;
+                }
+                case 5: {
+                    bool empty = model.empty();
+                    uint32_t value = buf.read();
+                    expect(empty ? value == 0 : value == model.front(), "read" + tag);
+                    if (!empty) model.pop_front();
+                    break;
+                }
+                case 6:
+                    if (rng() % 16 == 0) {
+                        buf.clear();
+                        model.clear();
+                    }
+                    break;
+                default:
+                    buf.write(next);
+                    model.push_back(next++);
+                    if (model.size() > capacity) model.pop_front();
+                    break;
+            }
+            expect(buf.getCurrSize() == model.size() && buf.getCurrSize() <= capacity, "size" + tag);
+        }
+    }
+    report("CircularBuffer", runBefore, failedBefore);
+}
+
+// A full-speed source waits only for channels something reads, so a
+// pipeline on either channel of a stereo stream keeps getting samples, and
+// again after a restart
+void checkSources(PlanRegistry &plans) {
+    uint32_t runBefore = checksRun, failedBefore = checksFailed;
+
+    for (uint32_t channel : {0u, 1u}) {
+        Recorder recorder(1024, 2, paNoDevice, BENCH_SAMPLE_RATE, 256);
+        recorder.setSource(make_unique<GeneratorSource>(GeneratorType::Tone, 1000, 0, 0, 0));
+        Pipeline pipeline(plans, recorder, 1024, 256, WindowType::Hann, 1, 8, channel);
+        for (uint32_t run = 0; run < 2; run++) {
+            string tag = " channels=2 speed=0 channel=" + to_string(channel) + " run=" + to_string(run);
+            expect(recorder.start(), "source start" + tag);
+            pipeline.start();
+
+            uint64_t first = 0, seq = 0;
+            auto deadline = chrono::steady_clock::now() + chrono::seconds(CHECK_SOURCE_SECONDS);
+            while (seq < CHECK_SOURCE_FRAMES && chrono::steady_clock::now() < deadline) {
+                SpectrumFrame *frame = pipeline.acquireLatest(chrono::microseconds(10000));
+                if (frame == nullptr) continue;
+                seq = frame->seq;
+                if (first == 0) first = seq;
+                pipeline.release(frame);
+            }
+            pipeline.stop();
+            recorder.stop();
+            expect(seq >= CHECK_SOURCE_FRAMES, "source keeps feeding" + tag + ": " + to_string(seq) + " spectra");
+            // At most the pool's frames can be in flight before the first one is shown
+            expect(first > 0 && first <= 8, "first spectrum shown" + tag + ": " + to_string(first));
+            expect(recorder.getOverruns() == 0, "source waits on its reader" + tag);
+        }
+    }
+
+    // A capture that does not loop plays once per start()
+    char path[] = "/tmp/iir-bench-XXXXXX";
+    int fd = mkstemp(path);
+    FILE *file = fd < 0 ? nullptr : fdopen(fd, "wb");
+    expect(file != nullptr, "source capture file");
+    if (file != nullptr) {
+        vector<float> samples(CHECK_SOURCE_FRAMES * 3, 0.25f);
+        expect(fwrite(samples.data(), sizeof(float), samples.size(), file) == samples.size(), "source capture written");
+        fclose(file);
+
+        struct CountingSink : SampleSink {
+            atomic<uint64_t> frames{0};
+            void deliver(const void *, uint32_t n, TimePoint, PaStreamCallbackFlags) override { frames += n; }
+            uint32_t space() override { return UINT32_MAX; }
+        } sink;
+        FileSource source(path, 0, false);
+        for (uint32_t run = 1; run <= 3; run++) {
+            uint32_t rate = 0;
+            expect(source.start(&sink, 1, rate, 100, SampleFormat::Float32), "file source start run=" + to_string(run));
+            uint64_t want = (uint64_t) CHECK_SOURCE_FRAMES * 3 * run;
+            auto deadline = chrono::steady_clock::now() + chrono::seconds(CHECK_SOURCE_SECONDS);
+            while (source.isRunning() && chrono::steady_clock::now() < deadline) {
+                this_thread::sleep_for(chrono::milliseconds(1));
+            }
+            expect(sink.frames == want, "file source replays after its end run=" + to_string(run) + ": " + to_string(sink.frames));
+        }
+        source.stop();
+        remove(path);
+    }
+    report("SampleSource", runBefore, failedBefore);
+}
+
+int main(int argc, char **argv) {
+    PlanRegistry plans;
+    if (argc > 1 && strcmp(argv[1], "--check") == 0) {
+        checkFilters();
+        checkSpectrum(plans);
+        checkConstantQ(plans);
+        checkAverages();
+        checkQ15();
+        checkArena();
+        checkBuffers();
+        checkSources(plans);
+        cout << checksRun << " checks, " << checksFailed << " failed" << endl;
+        return checksFailed == 0 ? 0 : 1;
+    }
+    benchBuffers();
+    benchFilters();
+    benchFFT(plans);
+    benchConstantQ(plans);
+    benchRender(plans);
+    return 0;
+}
@@ -0,0 +1,95 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "BatchFilter.hpp"
+#include "Biquad.hpp"
+
+#define DEFAULT_SAMPLE_RATE 16000
+#define DEFAULT_FILTER      "lowpass:1000"
+#define DEFAULT_Q           0.7071f
+
+using namespace std;
+
+void usage(const char *prog) {
+    cout << "Usage: " << prog << " [options] <input.raw|input.wav> <output> [<input> <output> ...]" << endl
+         << "  -s <type:hz[:q[:dB]]>  add a biquad section, repeatable (default " << DEFAULT_FILTER << ")" << endl
+         << "                         type is lowpass, highpass, bandpass, notch, peak, lowshelf or highshelf" << endl
+         << "  -r <hz>                sample rate of raw inputs (default " << DEFAULT_SAMPLE_RATE << ")" << endl
+         << "  -c <channels>          channels in raw inputs (default 1)" << endl
+         << "  -t <threads>           worker threads (default all cores)" << endl
+         << "Outputs keep the input's sample format (16-bit PCM WAV stays 16-bit, everything else is float32)" << endl
+         << "and get a WAV header when they end in .wav, none otherwise" << endl;
+}
+
+// "type:hz[:q[:dB]]"
+bool parseSection(const char *spec, FilterSection &section) {
+    string str = spec;
+    vector<string> fields;
+    size_t start = 0, colon;
+    while ((colon = str.find(':', start)) != string::npos) {
+        fields.push_back(str.substr(start, colon - start));
+        start = colon + 1;
+    }
+    fields.push_back(str.substr(start));
+    if (fields.size() < 2 || fields.size() > 4 || !parseBiquadType(fields[0].c_str(), section.type)) return false;
+    section.f0 = atof(fields[1].c_str());
+    section.q = fields.size() > 2 ? atof(fields[2].c_str()) : DEFAULT_Q;
+    section.gainDB = fields.size() > 3 ? atof(fields[3].c_str()) : 0;
+    return section.q > 0;
+}
+
+int main(int argc, char **argv) {
+    uint32_t sampleRate = DEFAULT_SAMPLE_RATE, rawChannels = 1, threads = 0;
+    vector<FilterSection> sections;
+    vector<const char*> files;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-r") == 0 && hasValue) sampleRate = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0 && hasValue) rawChannels = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && hasValue) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-s") == 0 && hasValue) {
+            FilterSection section;
+            if (!parseSection(argv[++i], section)) {
+                cout << "Bad filter section \'" << argv[i] << "\'" << endl;
+                return 1;
+            }
+            sections.push_back(section);
+        }
+        else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        }
+        else files.push_back(argv[i]);
+    }
+    if (files.empty() || files.size() % 2 != 0 || sampleRate == 0 || rawChannels == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (sections.empty()) {
+        FilterSection section;
+        parseSection(DEFAULT_FILTER, section);
+        sections.push_back(section);
+    }
+
+    BatchFilter filter(threads);
+    for (const FilterSection &section : sections) filter.addSection(section);
+    for (size_t i = 0; i < files.size(); i += 2) {
+        if (!filter.addFile(files[i], files[i + 1], rawChannels, sampleRate)) return 1;
+    }
+
+    auto start = chrono::steady_clock::now();
+    filter.run();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    uint64_t samples = filter.getSamplesFiltered();
+    cout << "Filtered " << samples << " samples through " << sections.size() << " section(s) in "
+         << seconds << " s on " << filter.getNumThreads() << " thread(s), "
+         << samples/seconds/1e6 << " MSamples/s" << endl;
+    return 0;
+}
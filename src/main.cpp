@@ -29,8 +29,13 @@ void bufferTest() {
     }
 }
 
-int main() {
-    App app = App();
-    app.readSamples("recorded.raw");
+int main(int argc, char **argv) {
+    Config config;
+    if (!config.parseArgs(argc, argv)) {
+        Config::usage(argv[0]);
+        return 1;
+    }
+    App app(config);
+    app.readSamples(config.captureFile.c_str());
     app.run();
 }
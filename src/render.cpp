@@ -0,0 +1,71 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "BatchRenderer.hpp"
+#include "PlanRegistry.hpp"
+#include "SampleFile.hpp"
+#include "STFT.hpp"
+
+#define DEFAULT_FFT_SIZE    1024
+#define DEFAULT_SAMPLE_RATE 16000
+
+using namespace std;
+
+void usage(const char *prog) {
+    cout << "Usage: " << prog << " [options] <input.raw|input.wav> <output.npy|output.png|output.f32>" << endl
+         << "  -f <size>      FFT size (default " << DEFAULT_FFT_SIZE << ")" << endl
+         << "  -o <hop>       hop size (default fft/4)" << endl
+         << "  -w <window>    hann, blackman, kaiser or rect (default hann)" << endl
+         << "  -c <channels>  channels in a raw input (default 1)" << endl
+         << "  -C <channel>   channel to analyze (default 0)" << endl
+         << "  -t <threads>   worker threads (default all cores)" << endl;
+}
+
+int main(int argc, char **argv) {
+    uint32_t fftSize = DEFAULT_FFT_SIZE, hopSize = 0, rawChannels = 1, channel = 0, threads = 0;
+    WindowType windowType = WindowType::Hann;
+    const char *input = nullptr, *output = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "-f") == 0 && hasValue) fftSize = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-o") == 0 && hasValue) hopSize = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-c") == 0 && hasValue) rawChannels = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-C") == 0 && hasValue) channel = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-t") == 0 && hasValue) threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-w") == 0 && hasValue) {
+            if (!parseWindow(argv[++i], windowType)) {
+                cout << "Unknown window \'" << argv[i] << "\'" << endl;
+                return 1;
+            }
+        }
+        else if (input == nullptr) input = argv[i];
+        else if (output == nullptr) output = argv[i];
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (input == nullptr || output == nullptr || fftSize < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (hopSize == 0) hopSize = fftSize/4;
+
+    SampleFile capture;
+    if (!capture.open(input, rawChannels, DEFAULT_SAMPLE_RATE)) return 1;
+
+    PlanRegistry plans;
+    BatchRenderer renderer(plans, fftSize, hopSize, windowType, threads);
+
+    auto start = chrono::steady_clock::now();
+    if (!renderer.render(capture, output, channel)) return 1;
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Wrote " << renderer.getFramesRendered() << " frames x " << fftSize/2 + 1
+         << " bins to \'" << output << "\' in " << seconds << " s" << endl;
+    return 0;
+}